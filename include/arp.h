@@ -23,10 +23,16 @@ typedef struct arp_pkt
 
 #pragma pack()
 
+extern uint32_t arp_generation;
+
+void arp_table_init();
 void arp_init();
 void arp_print();
-void arp_in(buf_t *buf, uint8_t *src_mac);
-void arp_out(buf_t *buf, uint8_t *ip);
-void arp_req(uint8_t *target_ip);
-void arp_resp(uint8_t *target_ip, uint8_t *target_mac);
+void arp_in(buf_t *buf, uint8_t *src_mac, net_if_t *netif);
+void arp_out(buf_t *buf, uint8_t *ip, net_if_t *netif);
+int arp_lookup(uint8_t *ip, uint8_t *mac);
+int arp_pending(uint8_t *ip);
+void arp_poll();
+void arp_req(uint8_t *target_ip, net_if_t *netif);
+void arp_resp(uint8_t *target_ip, uint8_t *target_mac, uint8_t *sender_ip, net_if_t *netif);
 #endif
\ No newline at end of file
@@ -5,10 +5,33 @@
 #include <stdint.h>
 #include "config.h"
 
+typedef enum buf_csum //接收时已验证的校验和，可按位组合
+{
+    BUF_CSUM_NONE = 0,    // 未验证
+    BUF_CSUM_L3 = 1 << 0, // ip首部校验和已验证
+    BUF_CSUM_L4 = 1 << 1, // 传输层校验和已验证
+} buf_csum_t;
+
+typedef struct buf_meta //收到数据包时由各层填写一次的元数据，上层直接读取而无需重新解析
+{
+    uint64_t rx_time_us; // 收到的时间，time_us的单调时钟
+    uint32_t l2_off;     // 链路层首部相对payload的偏移
+    uint32_t l3_off;     // 网络层首部相对payload的偏移
+    uint32_t l4_off;     // 传输层首部相对payload的偏移
+    uint8_t src_ip[4];   // 源ip地址
+    uint8_t dst_ip[4];   // 目的ip地址
+    uint16_t src_port;   // 源端口
+    uint16_t dst_port;   // 目的端口
+    uint8_t protocol;    // 传输层协议
+    uint8_t csum;        // 已验证的校验和，buf_csum_t的组合
+    uint32_t flow_hash;  // 五元组的流哈希，与flow_hash相同
+} buf_meta_t;
+
 typedef struct buf //协议栈的通用数据包buffer, 可以在头部装卸数据，以供协议头的添加和去除
 {
     size_t len;                   // 包中有效数据大小
     uint8_t *data;                // 包的数据起始地址
+    buf_meta_t meta;              // 收到的包的元数据，发送时不使用
     uint8_t payload[BUF_MAX_LEN]; // 最大负载数据量
 } buf_t;
 
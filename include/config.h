@@ -6,36 +6,110 @@
 #define IP
 #define ICMP
 #define UDP
+#define UDPLITE
+
+#define NET_STACK_PER_THREAD //每个线程运行独立的协议栈实例，协议栈状态为线程局部存储，约9MB，创建线程时栈须大于此
+#ifdef NET_STACK_PER_THREAD
+#ifdef _MSC_VER
+#define NET_TLS __declspec(thread)
+#else
+#define NET_TLS _Thread_local
+#endif
+#else
+#define NET_TLS
+#endif
 
 
 #ifdef TEST
-#define NET_IF_IP    \
-    {                   \
-        192, 168, 163, 103 \
-    } //测试用网卡ip地址
-#define NET_IF_MAC                      \
-    {                                      \
-        0x11, 0x22, 0x33, 0x44, 0x55, 0x66 \
-    } //测试用网卡mac地址
+#define NET_IF_CONFIG                                    \
+    {                                                    \
+        {                                                \
+            .name = "eth0",                              \
+            .mac = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66}, \
+            .ip = {{192, 168, 163, 103}},                \
+            .netmask = {255, 255, 255, 0},               \
+            .mtu = ETHERNET_MAX_TRANSPORT_UNIT,          \
+        },                                               \
+    } //测试用网卡表
+#define NET_IF_GATEWAYS      \
+    {                        \
+        {192, 168, 163, 2}   \
+    } //测试用默认路由的等价网关
 #else
-#define NET_IF_IP    \
-    {                   \
-        172, 31, 29, 76 \
-    } //自定义网卡ip地址
-#define NET_IF_MAC                      \
-    {                                      \
-        0x00, 0x11, 0x22, 0x33, 0x44, 0x55 \
-    } //自定义网卡mac地址
+#define NET_IF_CONFIG                                    \
+    {                                                    \
+        {                                                \
+            .name = "eth0",                              \
+            .mac = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55}, \
+            .ip = {{172, 31, 29, 76}},                   \
+            .netmask = {255, 255, 240, 0},               \
+            .mtu = ETHERNET_MAX_TRANSPORT_UNIT,          \
+        },                                               \
+    } //自定义网卡表，每块网卡一项，按ip地址匹配本机的物理网卡
+#define NET_IF_GATEWAYS      \
+    {                        \
+        {172, 31, 16, 1}     \
+    } //自定义默认路由的等价网关，按流哈希分担，全0的项被忽略，须与某块网卡在同一网段
 #endif 
 
 
 
 #define ETHERNET_MAX_TRANSPORT_UNIT 1500 //以太网最大传输单元
 
+#define WORKER_MAX_NUM 64                //按核分片运行的最大工作线程数
+#define WORKER_STACK_SIZE (64 << 20)     //工作线程的栈大小，须容纳线程局部存储中的协议栈实例
+#define PIPELINE_MAX_PROTO 8            //流水线最多的协议处理线程数
+#define PIPELINE_RING_DEPTH 1024        //流水线各环的深度
+#define PIPELINE_TX_SPIN 64             //发送环满时让出处理器后重试的次数，仍满则丢弃该帧
+
+#define NET_IF_MAX_NUM 8   //网卡表最多的网卡数
+#define NET_IF_MAX_IP 4    //每块网卡最多的ip地址数
+#define NET_POLL_BURST 32  //一次轮询每块网卡最多处理的接收包数
+#define DRIVER_TX_BURST 32 //批量发送队列长度
+
 #define ARP_TIMEOUT_SEC (60 * 5) //arp表过期时间
 #define ARP_MIN_INTERVAL 1       //向相同地址发送arp请求的最小间隔
 
+#define ICMP_RATE_LIMIT 1000    //icmp差错与回显响应的全局限速，每秒个数，0为不限速
+#define ICMP_RATE_BURST 50      //全局限速允许的突发数
+#ifdef TEST
+#define ICMP_SRC_RATE_LIMIT 1   //测试中每秒只补充1个，按地址限速的结果不随测试运行的快慢变化
+#else
+#define ICMP_SRC_RATE_LIMIT 100 //发往每个地址的icmp限速，每秒个数，0为不限速
+#endif
+#define ICMP_SRC_RATE_BURST 10  //按地址限速允许的突发数
+#define ICMP_SRC_BUCKET_NUM 256 //按地址限速的令牌桶数，地址按哈希映射到桶
+
+#define ICMP_PING_WINDOW 1024     //ping记录发送时间的未决序号数
+#define ICMP_PING_TIMEOUT_MS 1000 //ping最后一个请求发出后等待响应的时间
+
+#define HIST_SUB_BITS 4 //直方图每个2的幂区间线性等分为2^HIST_SUB_BITS个子桶
+
 #define IP_DEFALUT_TTL 64 //IP默认TTL
+#define IP_FORWARD_DEFAULT 0 //是否默认开启ip转发
+#define IP_PMTU_MIN 68                //路径mtu下限，即ipv4要求所有链路支持的最小mtu
+#define IP_PMTU_MAX_NUM 64            //路径mtu缓存的最大目的地址数
+#define IP_PMTU_TIMEOUT_SEC (60 * 10) //路径mtu过期时间，过期后重新按网卡mtu探测
+
+#define UDP_DONT_FRAGMENT 1 //udp是否默认置DF位，置位时超过路径mtu的数据报发送失败而不分片
+#define UDP_MAX_SOCKET 64   //同时打开的udp端口数
+#define UDP_HASH_NUM 256    //udp端口哈希表的桶数，须为2的幂
+#define UDP_GSO_MAX_SEGS 64 //udp_send_gso一次最多切分出的数据报数
+#define UDP_GRO_MAX 64      //一轮轮询中暂存的待合并递交的数据报数，满时提前递交
+#define UDP_CORK_MAX_LEN (ETHERNET_MAX_TRANSPORT_UNIT - 28) //塞住的已连接端口合并的最大数据长度
+#ifdef TEST
+#define UDP_EPHEMERAL_MIN 65496 //测试中缩小临时端口范围，端口表能同时打开全部临时端口，以测试绕回与耗尽
+#else
+#define UDP_EPHEMERAL_MIN 49152 //临时端口范围下限
+#endif
+#define UDP_EPHEMERAL_MAX 65535 //临时端口范围上限
+#define UDPLITE_MAX_SOCKET 16   //同时打开的udp-lite端口数
+#define UDP_RECV_DEPTH 256  //udp接收环的默认深度
+#define UDP_RECV_MAX_LEN (ETHERNET_MAX_TRANSPORT_UNIT - 28) //接收环每项可容纳的最大数据长度，更长的数据报被丢弃并计数
+
+#define ROUTE_MAX_NUM (1 << 17)     //路由表最大路由数
+#define ROUTE_TBL8_GROUP_NUM 4096   //长度大于24的前缀可用的tbl8组数
+#define ROUTE_MAX_ECMP 8            //一条路由最多的等价网关数
 
 #define BUF_MAX_LEN (2 * UINT16_MAX + UINT8_MAX) //buf最大长度
 
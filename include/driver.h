@@ -2,12 +2,28 @@
 #define DRIVER_H
 
 #include "net.h"
+#include "ring.h"
 
 #ifndef PCAP_BUF_SIZE
 #define PCAP_BUF_SIZE 1024
 #endif
-int driver_open();
-int driver_recv(buf_t *buf);
-int driver_send(buf_t *buf);
-void driver_close();
+void driver_set_shard(int index, int num);
+#define DRIVER_TX_FRAME_MAX (ETHERNET_MAX_TRANSPORT_UNIT + 2 * NET_MAC_LEN + 2) //可进入发送队列或环的最大帧长
+
+typedef struct driver_frame //环中的一个帧，环的槽位即帧缓冲区，生产者与消费者直接在槽位中读写
+{
+    net_if_t *netif;                   // 收到或发出帧的网卡
+    size_t len;                        // 帧长
+    uint8_t data[DRIVER_TX_FRAME_MAX]; // 帧数据
+} driver_frame_t;
+
+void driver_attach(ring_t *rx_rings, ring_t *tx_ring, uint64_t *tx_dropped);
+int driver_open(net_if_t *netif);
+int driver_recv_peek(net_if_t *netif, const uint8_t **data);
+int driver_recv(buf_t *buf, net_if_t *netif);
+int driver_send(buf_t *buf, net_if_t *netif);
+int driver_send_frame(net_if_t *netif, const uint8_t *data, size_t len);
+void driver_tx_begin();
+int driver_tx_flush();
+void driver_close(net_if_t *netif);
 #endif
\ No newline at end of file
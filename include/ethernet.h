@@ -15,8 +15,9 @@ typedef struct ether_hdr
 } ether_hdr_t;
 #pragma pack()
 void ethernet_init();
-void ethernet_in(buf_t *buf);
-void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol);
-void ethernet_poll();
+void ethernet_in(buf_t *buf, net_if_t *netif);
+void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol, net_if_t *netif);
+void ethernet_send(buf_t *buf, net_if_t *netif);
+int ethernet_poll(net_if_t *netif);
 static const uint8_t ether_broadcast_mac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}; //以太网广播mac地址
 #endif
\ No newline at end of file
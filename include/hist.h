@@ -0,0 +1,22 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdint.h>
+#include "config.h"
+
+#define HIST_SUB_BUCKET_NUM (1 << HIST_SUB_BITS)                     //每个2的幂区间内的线性子桶数
+#define HIST_BUCKET_NUM ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKET_NUM) //覆盖全部64位取值的桶数
+
+typedef struct hist //对数线性直方图，相对误差不超过1/HIST_SUB_BUCKET_NUM，记录与查询均为常数时间
+{
+    uint64_t counts[HIST_BUCKET_NUM]; // 各桶的计数
+    uint64_t total;                   // 记录的值的个数
+    uint64_t sum;                     // 记录的值的和
+    uint64_t min;                     // 最小值
+    uint64_t max;                     // 最大值
+} hist_t;
+
+void hist_init(hist_t *hist);
+void hist_record(hist_t *hist, uint64_t value);
+uint64_t hist_percentile(hist_t *hist, double percentile);
+#endif
@@ -2,6 +2,7 @@
 #define ICMP_H
 
 #include "net.h"
+#include "hist.h"
 
 #pragma pack(1)
 typedef struct icmp_hdr
@@ -19,14 +20,49 @@ typedef enum icmp_type
     ICMP_TYPE_ECHO_REQUEST = 8, // 回显请求
     ICMP_TYPE_ECHO_REPLY = 0,   // 回显响应
     ICMP_TYPE_UNREACH = 3,      // 目的不可达
+    ICMP_TYPE_TIME_EXCEEDED = 11, // 超时
 } icmp_type_t;
 
 typedef enum icmp_code
 {
+    ICMP_CODE_NET_UNREACH = 0,      // 网络不可达
     ICMP_CODE_PROTOCOL_UNREACH = 2, // 协议不可达
-    ICMP_CODE_PORT_UNREACH = 3      // 端口不可达
+    ICMP_CODE_PORT_UNREACH = 3,     // 端口不可达
+    ICMP_CODE_FRAG_NEEDED = 4,      // 需要分片但置了DF位
+    ICMP_CODE_TTL_EXCEEDED = 0,     // 传输中TTL耗尽
 } icmp_code_t;
-void icmp_in(buf_t *buf, uint8_t *src_ip);
+typedef struct icmp_stats //icmp统计
+{
+    uint64_t echo_replies; // 发出的回显响应
+    uint64_t errors;       // 发出的差错报文
+    uint64_t rate_limited; // 被限速而未发出的报文
+} icmp_stats_t;
+
+extern NET_TLS icmp_stats_t icmp_stats;
+
+typedef struct icmp_ping //一次ping会话，由net_poll驱动，不阻塞
+{
+    uint8_t dst_ip[NET_IP_LEN];         // 目的地址
+    uint16_t id;                        // 本会话请求的标识符
+    uint16_t count;                     // 要发送的请求数
+    uint16_t sent;                      // 已发送的请求数
+    uint16_t received;                  // 已收到的响应数
+    uint32_t interval_ms;               // 发送间隔
+    uint16_t size;                      // 每个请求的数据长度
+    uint64_t next_us;                   // 下一个请求的发送时间，全部发完后为会话结束时间
+    uint64_t send_us[ICMP_PING_WINDOW]; // 按序号记录的请求发送时间，0为已应答
+    hist_t rtt;                         // 往返时间直方图，单位微秒
+    int active;                         // 是否在进行
+} icmp_ping_t;
+
+extern NET_TLS icmp_ping_t icmp_ping_session;
+
+void icmp_in(buf_t *buf, uint8_t *src_ip, net_if_t *netif);
 void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code);
+void icmp_time_exceeded(buf_t *recv_buf, uint8_t *src_ip);
+void icmp_frag_needed(buf_t *recv_buf, uint8_t *src_ip, uint16_t mtu);
+int icmp_ping(uint8_t *dst_ip, uint16_t count, uint32_t interval_ms, uint16_t size);
+void icmp_ping_poll();
+void icmp_ping_print();
 void icmp_init();
 #endif
@@ -24,7 +24,42 @@ typedef struct ip_hdr
 #define IP_HDR_OFFSET_PER_BYTE 8   //ip分片偏移长度单位
 #define IP_VERSION_4 4             //ipv4
 #define IP_MORE_FRAGMENT (1 << 13) //ip分片mf位
-void ip_in(buf_t *buf, uint8_t *src_mac);
+#define IP_DONT_FRAGMENT (1 << 14) //ip禁止分片df位
+#define IP_FRAGMENT_OFFSET_MASK 0x1FFF //ip分片偏移掩码
+
+typedef struct ip_forward_stats //ip转发统计
+{
+    uint64_t forwarded;       // 已转发
+    uint64_t ttl_exceeded;    // TTL耗尽丢弃
+    uint64_t no_route;        // 无路由丢弃
+    uint64_t not_forwardable; // 广播或组播，不转发
+    uint64_t too_big;         // 置DF位且超过出口网卡mtu丢弃
+    uint64_t fragmented;      // 超过出口网卡mtu分片后转发
+} ip_forward_stats_t;
+
+typedef struct ip_tx_path //发往一个目的地址的已解析路径，批量发送时复用路由与arp查找的结果
+{
+    net_if_t *netif;              // 出口网卡
+    uint8_t mac[NET_MAC_LEN];     // 下一跳mac地址
+    uint16_t mtu;                 // 路径mtu
+    uint32_t generation;          // 解析时路由、arp与路径mtu的版本之和
+    time_t resolved;              // 解析时间
+    ip_hdr_t hdr;                 // ip首部模板，总长度、标识与校验和在发送时填写
+} ip_tx_path_t;
+
+extern NET_TLS ip_forward_stats_t ip_forward_stats;
+
+void ip_in(buf_t *buf, uint8_t *src_mac, net_if_t *netif);
 void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
+int ip_out_df(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
+uint16_t ip_mtu(uint8_t *dst_ip);
+void ip_pmtu_update(uint8_t *dst_ip, uint16_t mtu);
+uint8_t *ip_src_addr(uint8_t *dst_ip);
+uint16_t ip_next_id();
+int ip_path_resolve(ip_tx_path_t *path, uint8_t *dst_ip, net_protocol_t protocol, uint16_t src_port, uint16_t dst_port, int df);
+int ip_path_valid(ip_tx_path_t *path);
+void ip_path_out(ip_tx_path_t *path, buf_t *buf);
+void ip_forward_enable(int enable);
+void ip_route_init();
 void ip_init();
 #endif
\ No newline at end of file
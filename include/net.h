@@ -13,19 +13,54 @@ typedef enum net_protocol
     NET_PROTOCOL_ICMP = 1,
     NET_PROTOCOL_UDP = 17,
     NET_PROTOCOL_TCP = 6,
+    NET_PROTOCOL_UDPLITE = 136,
 } net_protocol_t;
 
-typedef void (*net_handler_t)(buf_t *buf, uint8_t *src);
-
 #define NET_MAC_LEN 6 //mac地址长度
 #define NET_IP_LEN 4  //ip地址长度
 
-extern uint8_t net_if_mac[NET_MAC_LEN];
-extern uint8_t net_if_ip[NET_IP_LEN];
-extern buf_t rxbuf, txbuf; //一个buf足够单线程使用
+typedef struct net_if_stats //网卡收发计数
+{
+    uint64_t rx_packets; // 收到的数据包数
+    uint64_t rx_bytes;   // 收到的字节数
+    uint64_t rx_dropped; // 格式错误而丢弃的数据包数
+    uint64_t tx_packets; // 发出的数据包数
+    uint64_t tx_bytes;   // 发出的字节数
+    uint64_t tx_errors;  // 发送失败的数据包数
+} net_if_stats_t;
+
+typedef struct net_if //一块网卡
+{
+    const char *name;                      // 网卡名，仅用于打印
+    uint8_t mac[NET_MAC_LEN];              // mac地址
+    uint8_t ip[NET_IF_MAX_IP][NET_IP_LEN]; // ip地址，ip[0]为主地址，全0的项未使用
+    uint8_t netmask[NET_IP_LEN];           // 子网掩码，所有地址共用
+    uint16_t mtu;                          // 最大传输单元
+} net_if_t;
+
+typedef struct net_if_state //网卡在一个协议栈实例中的状态，各实例各自打开网卡
+{
+    void *driver;         // 驱动句柄，由driver_open填写
+    net_if_stats_t stats; // 本实例的收发计数
+} net_if_state_t;
+
+#define NET_IF_STATE(netif) (&net_if_states[(netif) - net_if_table]) //网卡在当前协议栈实例中的状态
+
+typedef void (*net_handler_t)(buf_t *buf, uint8_t *src, net_if_t *netif);
+
+extern net_if_t net_if_table[];
+extern NET_TLS net_if_state_t net_if_states[NET_IF_MAX_NUM];
+extern const size_t net_if_num;
+extern uint8_t net_if_gateways[][NET_IP_LEN];
+extern const size_t net_if_gateway_num;
+extern NET_TLS buf_t rxbuf, txbuf; //每个协议栈实例一对
 
+void net_shared_init();
 int net_init();
-void net_poll();
-int net_in(buf_t *buf, uint16_t protocol, uint8_t *src);
+int net_poll();
+int net_in(buf_t *buf, uint16_t protocol, uint8_t *src, net_if_t *netif);
 void net_add_protocol(uint16_t protocol, net_handler_t handler);
+int net_if_has_ip(net_if_t *netif, const uint8_t *ip);
+net_if_t *net_if_find(const uint8_t *ip);
+uint8_t *net_if_src_ip(net_if_t *netif, const uint8_t *dst_ip);
 #endif
\ No newline at end of file
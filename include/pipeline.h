@@ -0,0 +1,19 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "net.h"
+#include "worker.h"
+
+typedef struct pipeline_stats //流水线收发线程的计数
+{
+    uint64_t rx_frames;  // 收线程放入接收环的帧数
+    uint64_t rx_dropped; // 接收环满或帧过长而丢弃的帧数
+    uint64_t tx_frames;  // 发线程发出的帧数
+    uint64_t tx_dropped; // 发送环满而丢弃的帧数，由各协议处理线程原子地累加
+} pipeline_stats_t;
+
+extern pipeline_stats_t pipeline_stats;
+
+int pipeline_start(int proto_num, worker_setup_t setup);
+void pipeline_stop();
+#endif
@@ -0,0 +1,31 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RING_CACHE_LINE 64 //缓存行大小，生产者与消费者的下标分处不同缓存行以免伪共享
+
+typedef struct ring //单生产者单消费者的无锁环形队列，元素定长，深度为2的幂
+{
+    uint8_t *slots;                                    // 元素存储区
+    size_t elem_size;                                  // 元素大小
+    uint32_t mask;                                     // 深度减1，用于下标取模
+    uint8_t pad0[RING_CACHE_LINE];                     // 填充
+    uint32_t head;                                     // 下一个写入位置，仅生产者修改
+    uint8_t pad1[RING_CACHE_LINE - sizeof(uint32_t)];  // 填充
+    uint32_t tail;                                     // 下一个读取位置，消费者出队或生产者丢弃最旧元素时修改
+    uint32_t reading;                                  // 消费者正在读取的位置，仅消费者访问
+    uint8_t pad2[RING_CACHE_LINE - 2 * sizeof(uint32_t)];// 填充
+} ring_t;
+
+int ring_init(ring_t *ring, size_t elem_size, uint32_t depth);
+void ring_free(ring_t *ring);
+uint32_t ring_depth(ring_t *ring);
+uint32_t ring_count(ring_t *ring);
+void *ring_enqueue_slot(ring_t *ring);
+void ring_enqueue_commit(ring_t *ring);
+int ring_drop_oldest(ring_t *ring);
+void *ring_dequeue_slot(ring_t *ring);
+int ring_dequeue_commit(ring_t *ring);
+#endif
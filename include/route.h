@@ -0,0 +1,35 @@
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include "net.h"
+
+#define ROUTE_TBL24_NUM (1 << 24)     //tbl24表项数，按目的地址高24位索引
+#define ROUTE_TBL8_GROUP_SIZE (1 << 8) //每个tbl8组的表项数，按目的地址低8位索引
+
+#define ROUTE_ENTRY_VALID (1u << 31)    //表项有效
+#define ROUTE_ENTRY_EXT (1u << 30)      //tbl24表项指向一个tbl8组
+#define ROUTE_ENTRY_DEPTH_SHIFT 24      //表项中前缀长度的偏移
+#define ROUTE_ENTRY_DEPTH_MASK 0x3F     //表项中前缀长度的掩码
+#define ROUTE_ENTRY_INDEX_MASK 0xFFFFFF //表项中路由或tbl8组下标的掩码
+
+typedef struct route //一条路由
+{
+    uint8_t prefix[NET_IP_LEN];                   // 目的网络前缀
+    uint8_t prefix_len;                           // 前缀长度
+    uint8_t gateway_num;                          // 等价网关数，0表示直连
+    uint8_t gateways[ROUTE_MAX_ECMP][NET_IP_LEN]; // 等价的下一跳网关，都须在出口网卡所在链路上
+    net_if_t *netif;                              // 出口网卡
+    uint8_t valid;                                // 是否有效
+} route_t;
+
+extern uint32_t route_generation;
+
+void route_init();
+int route_add(const uint8_t *prefix, uint8_t prefix_len, const uint8_t *gateway, net_if_t *netif);
+int route_add_multipath(const uint8_t *prefix, uint8_t prefix_len, const uint8_t (*gateways)[NET_IP_LEN], size_t gateway_num, net_if_t *netif);
+int route_delete(const uint8_t *prefix, uint8_t prefix_len);
+route_t *route_lookup(const uint8_t *ip);
+uint8_t *route_next_hop(route_t *route, uint8_t *ip, uint32_t flow_hash);
+size_t route_size();
+void route_print();
+#endif
@@ -2,6 +2,18 @@
 #define UDP_H
 
 #include "net.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "ring.h"
+#ifdef _WIN32
+struct iovec //分散的数据段，与posix的定义相同
+{
+    void *iov_base; // 起始地址
+    size_t iov_len; // 长度
+};
+#else
+#include <sys/uio.h>
+#endif
 
 #pragma pack(1)
 typedef struct udp_hdr
@@ -23,11 +35,92 @@ typedef struct udp_peso_hdr
 #pragma pack()
 
 typedef void (*udp_handler_t)(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port);
+typedef void (*udp_err_handler_t)(uint16_t port, uint8_t *dst_ip, uint16_t dst_port, uint8_t code);
+
+typedef enum udp_overflow
+{
+    UDP_OVERFLOW_DROP_NEW,    // 接收环满时丢弃新到的数据报
+    UDP_OVERFLOW_DROP_OLDEST, // 接收环满时丢弃最旧的数据报
+} udp_overflow_t;
+
+typedef struct udp_msg //一个数据报及其对端地址，用于批量收发
+{
+    uint8_t *data;          // 数据
+    size_t len;             // 数据长度，接收时传入缓冲区大小并返回数据长度
+    uint8_t ip[NET_IP_LEN]; // 对端ip地址
+    uint16_t port;          // 对端端口
+    buf_meta_t meta;        // 接收时的元数据，发送时忽略
+} udp_msg_t;
+
+typedef struct udp_socket_stats //udp端口的接收计数
+{
+    uint64_t rx_packets; // 进入接收环的数据报数
+    uint64_t rx_bytes;   // 进入接收环的数据字节数
+    uint64_t rx_dropped; // 因接收环满而丢弃的数据报数
+    uint64_t rx_too_big; // 超过UDP_RECV_MAX_LEN而丢弃的数据报数
+} udp_socket_stats_t;
+
+#define UDP_TX_HDR_LEN (sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + sizeof(udp_hdr_t)) //已连接端口的首部模板长度
+
+typedef struct udp_peer //已连接端口的对端与发送模板
+{
+    uint8_t ip[NET_IP_LEN];      // 对端ip地址
+    uint16_t port;               // 对端端口
+    ip_tx_path_t path;           // 已解析的路径，失效后在下次发送时重新解析
+    uint8_t hdr[UDP_TX_HDR_LEN]; // 以太网、ip与udp首部模板，长度、标识与校验和在发送时填写
+    uint32_t ip_sum;             // ip首部模板的校验和部分和
+    uint32_t pseudo_sum;         // 伪首部与udp首部模板的校验和部分和，不含长度
+    uint8_t resolved;            // 模板是否已按路径生成
+} udp_peer_t;
+
+struct udp_socket;
+typedef void (*udp_batch_handler_t)(struct udp_socket *sock, udp_msg_t *msgs, int n);
+
+typedef struct udp_socket //一个打开的udp端口
+{
+    uint16_t port;                 // 本地端口
+    udp_handler_t handler;         // 回调模式的处理程序，为NULL时数据报进入接收环
+    udp_batch_handler_t batch_handler; // 合并递交的处理程序，非NULL时优先于handler与接收环
+    udp_err_handler_t err_handler; // 收到icmp差错的处理程序，可为NULL
+    udp_overflow_t overflow;       // 接收环满时的丢弃策略
+    ring_t ring;                   // 接收环，协议栈为生产者，应用为消费者
+    udp_socket_stats_t stats;      // 接收计数
+    uint8_t connected;             // 是否已连接到对端
+    udp_peer_t peer;               // 已连接的对端
+    uint8_t corked;                // 是否塞住，塞住时发送的数据合并为一个数据报
+    uint16_t cork_len;             // 已合并的数据长度
+    uint8_t cork_data[UDP_CORK_MAX_LEN]; // 已合并的数据
+    uint8_t reuseport;             // 是否属于reuseport组
+    uint8_t used;                  // 是否已打开
+    struct udp_socket *next;       // 哈希链上的下一个端口
+} udp_socket_t;
 
 void udp_init();
-void udp_in(buf_t *buf, uint8_t *src_ip);
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
-void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+void udp_in(buf_t *buf, uint8_t *src_ip, net_if_t *netif);
+int udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+int udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+buf_t *udp_alloc_tx(uint16_t len);
+int udp_commit_tx(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+int udp_sendv(const struct iovec *iov, int iovcnt, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+int udp_send_batch(udp_msg_t *msgs, int n, uint16_t src_port);
+int udp_send_gso(uint8_t *data, size_t len, uint16_t segment_size, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+uint16_t udp_mtu(uint8_t *dst_ip);
 int udp_open(uint16_t port, udp_handler_t handler);
 void udp_close(uint16_t port);
+udp_socket_t *udp_socket(uint16_t port, uint32_t depth, udp_overflow_t overflow);
+udp_socket_t *udp_socket_reuseport(uint16_t port, uint32_t depth, udp_overflow_t overflow);
+void udp_sock_close(udp_socket_t *sock);
+udp_socket_t *udp_connect(uint16_t port, uint8_t *dst_ip, uint16_t dst_port);
+int udp_sock_commit_tx(udp_socket_t *sock, buf_t *buf);
+int udp_sock_send(udp_socket_t *sock, uint8_t *data, uint16_t len);
+int udp_sock_cork(udp_socket_t *sock, int enable);
+int udp_sock_flush(udp_socket_t *sock);
+void udp_flush_corked();
+int udp_recv(udp_socket_t *sock, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t *src_port);
+int udp_recv_batch(udp_socket_t *sock, udp_msg_t *msgs, int n);
+int udp_set_err_handler(uint16_t port, udp_err_handler_t handler);
+void udp_set_batch_handler(udp_socket_t *sock, udp_batch_handler_t handler);
+void udp_gro_flush();
+const buf_meta_t *udp_current_meta();
+void udp_err_in(buf_t *buf, uint8_t code);
 #endif
\ No newline at end of file
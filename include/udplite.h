@@ -0,0 +1,33 @@
+#ifndef UDPLITE_H
+#define UDPLITE_H
+
+#include "net.h"
+#include "udp.h"
+
+#pragma pack(1)
+typedef struct udplite_hdr
+{
+    uint16_t src_port16;  // 源端口
+    uint16_t dst_port16;  // 目标端口
+    uint16_t coverage16;  // 校验和覆盖长度，含首部，0为覆盖整个数据报
+    uint16_t checksum16;  // 校验和，不能为0
+} udplite_hdr_t;
+#pragma pack()
+
+typedef struct udplite_socket //一个打开的udp-lite端口
+{
+    uint16_t port;          // 本地端口
+    udp_handler_t handler;  // 处理程序
+    uint16_t send_coverage; // 发送时的校验和覆盖长度，含首部，0为全部
+    uint16_t recv_coverage; // 接收时要求的最小覆盖长度，含首部，0为要求全部
+    uint8_t used;           // 是否已打开
+} udplite_socket_t;
+
+void udplite_init();
+void udplite_in(buf_t *buf, uint8_t *src_ip, net_if_t *netif);
+int udplite_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port, uint16_t coverage);
+int udplite_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+int udplite_open(uint16_t port, udp_handler_t handler);
+void udplite_close(uint16_t port);
+int udplite_set_coverage(uint16_t port, uint16_t send_coverage, uint16_t recv_coverage);
+#endif
@@ -5,10 +5,25 @@
 #include <time.h>
 
 uint16_t checksum16(uint16_t *data, size_t len);
+uint32_t checksum32_add(uint32_t sum, const uint8_t *data, size_t len);
+uint16_t checksum32_fold(uint32_t sum);
+uint16_t checksum16_update(uint16_t checksum, uint16_t old_word, uint16_t new_word);
 #define swap16(x) ((((x)&0xFF) << 8) | (((x) >> 8) & 0xFF)) //为16位数据交换大小端
 
 char *iptos(uint8_t *ip);
 char *mactos(uint8_t *mac);
 char *timetos(time_t timestamp);
 uint8_t ip_prefix_match(uint8_t *ipa, uint8_t *ipb);
+uint32_t flow_hash(const uint8_t *src_ip, const uint8_t *dst_ip, uint8_t protocol, uint16_t src_port, uint16_t dst_port);
+
+typedef struct token_bucket //令牌桶
+{
+    uint64_t interval_us;  // 生成一个令牌的间隔，0为不限速
+    uint64_t tolerance_us; // 桶容量折算成的时间，即允许超前的时间
+    uint64_t tat_us;       // 下一个令牌的理论到达时间
+} token_bucket_t;
+
+uint64_t time_us();
+void token_bucket_init(token_bucket_t *bucket, uint32_t rate, uint32_t burst);
+int token_bucket_take(token_bucket_t *bucket, uint64_t now_us);
 #endif
\ No newline at end of file
@@ -0,0 +1,12 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include "net.h"
+
+typedef void (*worker_setup_t)(int index); //工作线程初始化协议栈后调用，用于在本实例中打开端口等
+
+int worker_start(int num, worker_setup_t setup);
+void worker_stop();
+int worker_pin(int core);
+int worker_num();
+#endif
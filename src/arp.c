@@ -12,21 +12,72 @@ static const arp_pkt_t arp_init_pkt = {
     .pro_type16 = swap16(NET_PROTOCOL_IP),
     .hw_len = NET_MAC_LEN,
     .pro_len = NET_IP_LEN,
-    .sender_ip = NET_IF_IP,
-    .sender_mac = NET_IF_MAC,
     .target_mac = {0}};
 
 /**
  * @brief arp地址转换表，<ip,mac>的容器
+ *        各协议栈实例共用，以便任一实例收到的arp响应对所有实例可见
+ *        由顺序锁保护：写者之间以arp_write_lock互斥，读者不加锁，读取前后arp_table_seq不变才有效
  * 
  */
 map_t arp_table;
+static int arp_write_lock;
+static uint32_t arp_table_seq;
 
 /**
- * @brief arp buffer，<ip,buf_t>的容器
+ * @brief arp表是否已初始化
  * 
  */
-map_t arp_buf;
+static int arp_table_ready;
+
+/**
+ * @brief 本次启动是否已发送过无偿arp，各实例共用网卡，只需第一个初始化的实例发送
+ * 
+ */
+static int arp_announced;
+
+/**
+ * @brief arp表版本，学到新的或改变了的映射时加1，缓存了mac地址的调用者据此判断是否失效
+ * 
+ */
+uint32_t arp_generation;
+
+/**
+ * @brief arp buffer，<ip,buf_t>的容器，每个协议栈实例各自缓存等待解析的数据包
+ * 
+ */
+NET_TLS map_t arp_buf;
+
+/**
+ * @brief arp_poll上次检查时的arp表版本，以及检查中找到的已解析的待发地址
+ * 
+ */
+static NET_TLS uint32_t arp_poll_generation;
+static NET_TLS uint8_t arp_ready_ips[MAP_MAX_LEN / sizeof(buf_t)][NET_IP_LEN];
+static NET_TLS size_t arp_ready_num;
+
+/**
+ * @brief 开始写arp表，与其他写者互斥，并将序号置为奇数使并发的读者重试
+ *        临界区只有表的更新，因此自旋等待
+ * 
+ */
+static void arp_write_begin()
+{
+    while (__atomic_exchange_n(&arp_write_lock, 1, __ATOMIC_ACQUIRE))
+        ;
+    __atomic_store_n(&arp_table_seq, arp_table_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 结束写arp表，序号恢复为偶数
+ * 
+ */
+static void arp_write_end()
+{
+    __atomic_store_n(&arp_table_seq, arp_table_seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&arp_write_lock, 0, __ATOMIC_RELEASE);
+}
 
 /**
  * @brief 打印一条arp表项
@@ -47,7 +98,11 @@ void arp_entry_print(void *ip, void *mac, time_t *timestamp)
 void arp_print()
 {
     printf("===ARP TABLE BEGIN===\n");
+    // 打印较慢，持写者锁以免遍历中途表被改写
+    while (__atomic_exchange_n(&arp_write_lock, 1, __ATOMIC_ACQUIRE))
+        ;
     map_foreach(&arp_table, arp_entry_print);
+    __atomic_store_n(&arp_write_lock, 0, __ATOMIC_RELEASE);
     printf("===ARP TABLE  END ===\n");
 }
 
@@ -55,17 +110,20 @@ void arp_print()
  * @brief 发送一个arp请求
  * 
  * @param target_ip 想要知道的目标的ip地址
+ * @param netif 发出请求的网卡
  */
-void arp_req(uint8_t *target_ip)
+void arp_req(uint8_t *target_ip, net_if_t *netif)
 {
     // TO-DO
     buf_t *buf = &txbuf;
     buf_init(buf, sizeof(arp_pkt_t));  //初始化txbuf
     arp_pkt_t packet = arp_init_pkt;
     packet.opcode16 = swap16(ARP_REQUEST);  //填充opcode
+    memcpy(packet.sender_ip, net_if_src_ip(netif, target_ip), NET_IP_LEN);  //填充sender_ip
+    memcpy(packet.sender_mac, netif->mac, NET_MAC_LEN);  //填充sender_mac
     memcpy(packet.target_ip, target_ip, NET_IP_LEN);  //填充target_ip
     memcpy(buf->data, &packet, sizeof(arp_pkt_t));
-    ethernet_out(buf, ether_broadcast_mac, NET_PROTOCOL_ARP);
+    ethernet_out(buf, ether_broadcast_mac, NET_PROTOCOL_ARP, netif);
 }
 
 /**
@@ -73,18 +131,22 @@ void arp_req(uint8_t *target_ip)
  * 
  * @param target_ip 目标ip地址
  * @param target_mac 目标mac地址
+ * @param sender_ip 被询问的本机ip地址
+ * @param netif 发出响应的网卡
  */
-void arp_resp(uint8_t *target_ip, uint8_t *target_mac)
+void arp_resp(uint8_t *target_ip, uint8_t *target_mac, uint8_t *sender_ip, net_if_t *netif)
 {
     // TO-DO
     buf_t *buf = &txbuf;
     buf_init(buf, sizeof(arp_pkt_t));  //初始化txbuf
     arp_pkt_t packet = arp_init_pkt;
     packet.opcode16 = swap16(ARP_REPLY);  //填充opcode
+    memcpy(packet.sender_ip, sender_ip, NET_IP_LEN);  //填充sender_ip
+    memcpy(packet.sender_mac, netif->mac, NET_MAC_LEN);  //填充sender_mac
     memcpy(packet.target_ip, target_ip, NET_IP_LEN);  //填充target_ip
     memcpy(packet.target_mac, target_mac, NET_MAC_LEN);  //填充target_mac
     memcpy(buf->data, &packet, sizeof(arp_pkt_t));
-    ethernet_out(buf, target_mac, NET_PROTOCOL_ARP); 
+    ethernet_out(buf, target_mac, NET_PROTOCOL_ARP, netif); 
 }
 
 /**
@@ -97,8 +159,9 @@ void arp_resp(uint8_t *target_ip, uint8_t *target_mac)
  * 
  * @param buf 要处理的数据包
  * @param src_mac 源mac地址
+ * @param netif 收到数据包的网卡
  */
-void arp_in(buf_t *buf, uint8_t *src_mac)
+void arp_in(buf_t *buf, uint8_t *src_mac, net_if_t *netif)
 {
     // TO-DO
     // arp数据包的最小长度
@@ -115,27 +178,24 @@ void arp_in(buf_t *buf, uint8_t *src_mac)
     // opcode，ARP请求，ARP响应，ARP错误
     if(arp->opcode16 != swap16(ARP_HW_ETHER) && arp->opcode16 != swap16(ARP_REPLY) && arp->opcode16 != swap16(ARP_REQUEST)) return;
     // 将目标ip和mac地址添加到arp表中
+    arp_write_begin();
+    uint8_t *old_mac = map_get(&arp_table, arp->sender_ip);
+    int changed = old_mac == NULL || memcmp(old_mac, arp->sender_mac, NET_MAC_LEN);
     map_set(&arp_table, arp->sender_ip, arp->sender_mac);
+    arp_write_end();
+    if (changed)
+        __atomic_add_fetch(&arp_generation, 1, __ATOMIC_RELEASE);
     // 查看缓存中是否已经存在该ip的arp数据包
     buf_t* map_buf = map_get(&arp_buf, (void*) arp->sender_ip);
     if(map_buf == NULL){
-        // 如果是arp请求，并且是对本机的arp请求
-        if(arp->opcode16 == swap16(ARP_REQUEST)){
-            int flag = 1;
-            for(int i = 0; i < NET_IP_LEN; i++){
-                if(arp->target_ip[i] != net_if_ip[i]){
-                    flag =  0;
-                    break;
-                }
-            }
-            if(flag){
-                arp_resp(arp->sender_ip, src_mac);
-            }
+        // 如果是arp请求，并且是对本网卡某个地址的arp请求
+        if(arp->opcode16 == swap16(ARP_REQUEST) && net_if_has_ip(netif, arp->target_ip)){
+            arp_resp(arp->sender_ip, src_mac, arp->target_ip, netif);
         }
     }
     else{
-        // 如果是arp响应，直接将缓存中的arp数据包发送出去
-        ethernet_out(map_buf, arp->sender_mac, NET_PROTOCOL_IP);
+        // 如果是arp响应，直接将缓存中的arp数据包从收到响应的网卡发送出去
+        ethernet_out(map_buf, arp->sender_mac, NET_PROTOCOL_IP, netif);
         // 将缓存中的arp数据包删除
         map_delete(&arp_buf, arp->sender_ip);
     }
@@ -145,34 +205,158 @@ void arp_in(buf_t *buf, uint8_t *src_mac)
  * 
  * @param buf 要处理的数据包
  * @param ip 目标ip地址
- * @param protocol 上层协议
+ * @param netif 出口网卡
  */
-void arp_out(buf_t *buf, uint8_t *ip)
+void arp_out(buf_t *buf, uint8_t *ip, net_if_t *netif)
 {
     // TO-DO
-    uint8_t *target_mac = map_get(&arp_table, ip);
-    if(target_mac == NULL){
+    uint8_t target_mac[NET_MAC_LEN];
+    if(arp_lookup(ip, target_mac) < 0){
         buf_t *cache_buf = map_get(&arp_buf, ip);
         if(cache_buf != NULL){
             return;
         }else{
             //设置目标ip的map缓存
             map_set(&arp_buf, ip, buf);
-            arp_req(ip);
+            arp_req(ip, netif);
         }
     }else{
-        ethernet_out(buf, target_mac, NET_PROTOCOL_IP);
+        ethernet_out(buf, target_mac, NET_PROTOCOL_IP, netif);
     }
 }
 
+/**
+ * @brief 查找ip地址对应的mac地址，不发送arp请求
+ *        arp表为各实例共用，因此复制出mac地址而不是返回表中的指针
+ *        每个数据包都要查找，因此不加锁：读到一半表被改写时按序号重读
+ * 
+ * @param ip 要查找的ip地址
+ * @param mac 返回mac地址，可为NULL
+ * @return int 已解析为0，否则为-1
+ */
+int arp_lookup(uint8_t *ip, uint8_t *mac)
+{
+    uint8_t found[NET_MAC_LEN];
+    uint8_t *entry;
+    uint32_t seq;
+    do
+    {
+        seq = __atomic_load_n(&arp_table_seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+        entry = map_get(&arp_table, ip);
+        if (entry)
+            memcpy(found, entry, NET_MAC_LEN);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || __atomic_load_n(&arp_table_seq, __ATOMIC_RELAXED) != seq);
+    if (entry && mac)
+        memcpy(mac, found, NET_MAC_LEN);
+    return entry ? 0 : -1;
+}
+
+/**
+ * @brief 判断本实例是否已有发往该地址的数据包在等待arp解析
+ *        arp_out对每个地址只缓存一个数据包，此时再发往该地址的数据包会被丢弃
+ * 
+ * @param ip 下一跳ip地址
+ * @return int 有数据包在等待为1，否则为0
+ */
+int arp_pending(uint8_t *ip)
+{
+    return map_get(&arp_buf, ip) != NULL;
+}
+
+/**
+ * @brief 内部函数，按地址所在网段选择发送等待解析的数据包的网卡
+ * 
+ * @param ip 下一跳ip地址
+ * @return net_if_t* 网卡，不在任何网卡的网段内为NULL
+ */
+static net_if_t *arp_netif(const uint8_t *ip)
+{
+    for (size_t i = 0; i < net_if_num; i++)
+    {
+        net_if_t *netif = &net_if_table[i];
+        for (size_t j = 0; j < NET_IF_MAX_IP; j++)
+        {
+            if (!net_if_has_ip(netif, netif->ip[j]))
+                continue;
+            int k = 0;
+            while (k < NET_IP_LEN && !((ip[k] ^ netif->ip[j][k]) & netif->netmask[k]))
+                k++;
+            if (k == NET_IP_LEN)
+                return netif;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 内部函数，记录已解析的待发地址
+ * 
+ * @param ip 等待解析的ip地址
+ * @param buf 等待发送的数据包
+ * @param timestamp 缓存时间
+ */
+static void arp_pending_check(void *ip, void *buf, time_t *timestamp)
+{
+    if (arp_ready_num < sizeof(arp_ready_ips) / NET_IP_LEN && arp_lookup(ip, NULL) == 0)
+        memcpy(arp_ready_ips[arp_ready_num++], ip, NET_IP_LEN);
+}
+
+/**
+ * @brief 发出本实例中已被其他实例解析的等待发送的数据包，由net_poll调用
+ *        arp响应只被一个实例收到，其他实例据arp表版本的变化发现解析完成
+ * 
+ */
+void arp_poll()
+{
+    uint32_t generation = __atomic_load_n(&arp_generation, __ATOMIC_ACQUIRE);
+    if (generation == arp_poll_generation || map_size(&arp_buf) == 0)
+        return;
+    arp_poll_generation = generation;
+    arp_ready_num = 0;
+    map_foreach(&arp_buf, arp_pending_check);
+    for (size_t i = 0; i < arp_ready_num; i++)
+    {
+        uint8_t mac[NET_MAC_LEN];
+        buf_t *buf = map_get(&arp_buf, arp_ready_ips[i]);
+        net_if_t *netif = arp_netif(arp_ready_ips[i]);
+        if (buf && netif && arp_lookup(arp_ready_ips[i], mac) == 0)
+            ethernet_out(buf, mac, NET_PROTOCOL_IP, netif);
+        map_delete(&arp_buf, arp_ready_ips[i]);
+    }
+}
+
+/**
+ * @brief 初始化各协议栈实例共用的arp表，进程内只初始化一次，每次调用使下一个初始化的实例重新发送无偿arp
+ *        没有其他实例运行时才能调用，多线程运行时由net_shared_init在启动线程前调用
+ * 
+ */
+void arp_table_init()
+{
+    __atomic_store_n(&arp_announced, 0, __ATOMIC_RELEASE);
+    if (arp_table_ready)
+        return;
+    map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
+    arp_table_ready = 1;
+}
+
 /**
  * @brief 初始化arp协议
  * 
  */
 void arp_init()
 {
-    map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
+    if (!arp_table_ready)
+        arp_table_init();
     map_init(&arp_buf, NET_IP_LEN, sizeof(buf_t), 0, ARP_MIN_INTERVAL, buf_copy);
     net_add_protocol(NET_PROTOCOL_ARP, arp_in);
-    arp_req(net_if_ip);
+    if (__atomic_exchange_n(&arp_announced, 1, __ATOMIC_ACQ_REL))
+        return;
+    // 在每块网卡上为其每个地址发送无偿arp
+    for (size_t i = 0; i < net_if_num; i++)
+        for (size_t j = 0; j < NET_IF_MAX_IP; j++)
+            if (net_if_has_ip(&net_if_table[i], net_if_table[i].ip[j]))
+                arp_req(net_if_table[i].ip[j], &net_if_table[i]);
 }
\ No newline at end of file
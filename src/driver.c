@@ -1,4 +1,5 @@
 #include <pcap.h>
+#include <sched.h>
 #include "driver.h"
 
 #ifdef _WIN32
@@ -28,8 +29,43 @@ BOOL LoadNpcapDlls()
 }
 #endif
 
-pcap_t *pcap;
-char pcap_errbuf[PCAP_ERRBUF_SIZE];
+NET_TLS char pcap_errbuf[PCAP_ERRBUF_SIZE];
+
+static NET_TLS int driver_tx_deferred; //批量发送的嵌套层数
+
+/**
+ * @brief 当前协议栈实例挂接的接收环与发送环，挂接后不再直接访问网卡
+ *        接收环每块网卡一个，按网卡表下标对应
+ * 
+ */
+static NET_TLS ring_t *driver_rx_rings;
+static NET_TLS ring_t *driver_tx_ring;
+static NET_TLS uint64_t *driver_tx_dropped; //发送环满而丢弃的帧数，可能由多个实例共用
+
+/**
+ * @brief 当前协议栈实例接收的分片及分片总数，分片总数不大于1时接收全部数据包
+ * 
+ */
+static NET_TLS int driver_shard_index;
+static NET_TLS int driver_shard_num;
+
+/**
+ * @brief 已打开的网卡数
+ * 
+ */
+static NET_TLS size_t driver_open_num;
+
+#ifdef _WIN32
+/**
+ * @brief Npcap的发送队列，driver_tx_begin与driver_tx_flush之间发送的数据包直接复制到此，
+ *        一次系统调用发出整批数据包。队列中的数据包都发往driver_sendqueue_pcap，各网卡共用
+ *        其他平台的libpcap没有批量发送接口，数据包总是立即发送，不经过队列
+ * 
+ */
+static NET_TLS pcap_send_queue *driver_sendqueue;
+static NET_TLS pcap_t *driver_sendqueue_pcap;
+static NET_TLS size_t driver_sendqueue_num;
+#endif
 
 /**
  * @brief 根据ip进行前缀匹配，选取最长前缀匹配的网卡
@@ -82,7 +118,7 @@ int driver_find(uint8_t *ip, char *if_name, uint8_t *mask)
         ;
     if (max_match == 32)
     {
-        fprintf(stderr, "Error, interface %s have the same ip %s with me.\n", d->name, iptos(net_if_ip));
+        fprintf(stderr, "Error, interface %s have the same ip %s with me.\n", d->name, iptos(ip));
         return -1;
     }
     for (a = d->addresses; a; a = a->next)
@@ -93,16 +129,76 @@ int driver_find(uint8_t *ip, char *if_name, uint8_t *mask)
     return 0;
 }
 
+// 分片过滤条件：未分片的目的不可达报文，其引用的原数据报是否为未分片的udp数据报，以及原数据报的端口，原数据报的首部从icmp[8]开始
+#define DRIVER_SHARD_UNREACH "(ip[6:2] & 0x3fff = 0 and icmp and icmp[0] = 3)"
+#define DRIVER_SHARD_INNER_UDP "(icmp[17] = 17 and icmp[14:2] & 0x3fff = 0)"
+#define DRIVER_SHARD_INNER_PORTS "icmp[8 + ((icmp[8] & 0xf) << 2):2] ^ icmp[10 + ((icmp[8] & 0xf) << 2):2]"
+
+/**
+ * @brief 内部函数，生成只接收一个分片的过滤条件，各分片的条件互不相交且合起来覆盖全部数据包
+ *        未分片的udp数据报按地址与端口散列，其他ip数据包按地址散列，使同一流总在同一分片，
+ *        目的不可达报文按其引用的原数据报散列，散列对源与目的对称，因此进入发出原数据报的流所在的分片，
+ *        其路径mtu与差错能被该实例处理；arp等非ip数据包都进入分片0
+ * 
+ * @param filter 追加到已有过滤条件之后的缓冲区
+ * @param index 分片号
+ * @param num 分片总数
+ */
+static void driver_shard_filter(char *filter, int index, int num)
+{
+    filter += sprintf(filter, " and (");
+    if (index == 0)
+        filter += sprintf(filter, "not ip or ");
+    sprintf(filter,
+            "(ip and ip[6:2] & 0x3fff = 0 and udp and (ip[12:4] ^ ip[16:4] ^ udp[0:2] ^ udp[2:2]) %% %d = %d) or "
+            "(ip and " DRIVER_SHARD_UNREACH " and " DRIVER_SHARD_INNER_UDP " and (icmp[20:4] ^ icmp[24:4] ^ " DRIVER_SHARD_INNER_PORTS ") %% %d = %d) or "
+            "(ip and " DRIVER_SHARD_UNREACH " and not " DRIVER_SHARD_INNER_UDP " and (icmp[20:4] ^ icmp[24:4]) %% %d = %d) or "
+            "(ip and not (ip[6:2] & 0x3fff = 0 and udp) and not " DRIVER_SHARD_UNREACH " and (ip[12:4] ^ ip[16:4]) %% %d = %d))",
+            num, index, num, index, num, index, num, index);
+}
+
+/**
+ * @brief 设置当前协议栈实例之后打开的网卡只接收一个分片，须在net_init之前调用
+ *        每个实例用不相交的过滤条件各自打开网卡，内核按条件把数据包分给各实例的接收队列
+ * 
+ * @param index 分片号
+ * @param num 分片总数，不大于1时接收全部数据包
+ */
+void driver_set_shard(int index, int num)
+{
+    driver_shard_index = index;
+    driver_shard_num = num;
+}
+
+/**
+ * @brief 把当前协议栈实例挂接到环上，须在net_init之前调用
+ *        之后本实例不打开网卡，driver_recv从接收环取帧，driver_send把帧放入发送环，
+ *        由其他线程负责收发，协议处理线程不再进行系统调用
+ * 
+ * @param rx_rings 接收环数组，每块网卡一个，元素为driver_frame_t，NULL为取消挂接
+ * @param tx_ring 发送环，元素为driver_frame_t
+ * @param tx_dropped 发送环满而丢弃帧时原子地加1的计数，可为NULL
+ */
+void driver_attach(ring_t *rx_rings, ring_t *tx_ring, uint64_t *tx_dropped)
+{
+    driver_rx_rings = rx_rings;
+    driver_tx_ring = tx_ring;
+    driver_tx_dropped = tx_dropped;
+}
+
 /**
- * @brief 打开网卡
+ * @brief 打开网卡，按网卡的主地址匹配本机的物理网卡
  * 
+ * @param netif 要打开的网卡，成功后填写其驱动句柄
  * @return int 成功为0，失败为-1
  */
-int driver_open()
+int driver_open(net_if_t *netif)
 {
+    if (driver_rx_rings)
+        return 0;
 #ifdef _WIN32
     /* Load Npcap and its functions. */
-    if (!LoadNpcapDlls())
+    if (driver_open_num == 0 && !LoadNpcapDlls())
     {
         fprintf(stderr, "Couldn't load Npcap\n");
         return -1;
@@ -111,12 +207,13 @@ int driver_open()
 
     char if_name[PCAP_BUF_SIZE];
     uint32_t mask;
-    if (driver_find(net_if_ip, if_name, (uint8_t *)&mask) < 0)
+    pcap_t *pcap;
+    if (driver_find(netif->ip[0], if_name, (uint8_t *)&mask) < 0)
     {
         fprintf(stderr, "Error in driver find.\n");
         return -1;
     }
-    printf("Using interface %s, my ip is %s.\n", if_name, iptos(net_if_ip));
+    printf("Using interface %s as %s, my ip is %s.\n", if_name, netif->name, iptos(netif->ip[0]));
 
     if ((pcap = pcap_open_live(if_name, 65536, 1, 10, pcap_errbuf)) == NULL) //混杂模式打开网卡
     {
@@ -130,11 +227,13 @@ int driver_open()
     }
     char filter_exp[PCAP_BUF_SIZE];
     struct bpf_program fp;
-    uint8_t mac_addr[6] = NET_IF_MAC;
-    sprintf(filter_exp, //过滤数据包
-            "(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether broadcast) and (not ether src %02x:%02x:%02x:%02x:%02x:%02x)",
-            mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5],
-            mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
+    uint8_t *mac_addr = netif->mac;
+    int len = sprintf(filter_exp, //过滤数据包
+                      "(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether broadcast) and (not ether src %02x:%02x:%02x:%02x:%02x:%02x)",
+                      mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5],
+                      mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
+    if (driver_shard_num > 1)
+        driver_shard_filter(filter_exp + len, driver_shard_index, driver_shard_num);
     if (pcap_compile(pcap, &fp, filter_exp, 0, mask) < 0)
     {
         fprintf(stderr, "Error in pcap_compile.\n%s.\n", pcap_geterr(pcap));
@@ -145,51 +244,220 @@ int driver_open()
         fprintf(stderr, "Error in pcap_setfilter.\n%s.\n", pcap_geterr(pcap));
         return -1;
     }
+#ifdef _WIN32
+    if (driver_sendqueue == NULL &&
+        (driver_sendqueue = pcap_sendqueue_alloc(DRIVER_TX_BURST * (DRIVER_TX_FRAME_MAX + sizeof(struct pcap_pkthdr)))) == NULL)
+    {
+        fprintf(stderr, "Error in pcap_sendqueue_alloc.\n");
+        return -1;
+    }
+#endif
+    NET_IF_STATE(netif)->driver = pcap;
+    driver_open_num++;
     return 0;
 }
 /**
- * @brief 试图从网卡接收数据包
+ * @brief 试图从网卡接收数据包但不复制，返回的数据在下一次接收前有效
  * 
- * @param buf 收到的数据包
+ * @param netif 要接收的网卡
+ * @param data 返回数据包的数据
  * @return int 数据包的长度，未收到为0，错误为-1
  */
-int driver_recv(buf_t *buf)
+int driver_recv_peek(net_if_t *netif, const uint8_t **data)
 {
+    pcap_t *pcap = NET_IF_STATE(netif)->driver;
     struct pcap_pkthdr *pkt_hdr;
-    const uint8_t *pkt_data;
-    int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
+    int ret = pcap_next_ex(pcap, &pkt_hdr, data);
     if (ret == 0)
         return 0;
     else if (ret == 1)
-    {
-        memcpy(buf->data, pkt_data, pkt_hdr->len);
-        buf->len = pkt_hdr->len;
         return pkt_hdr->len;
-    }
     fprintf(stderr, "Error in driver_recv.\n%s.\n", pcap_geterr(pcap));
     return -1;
 }
+
 /**
- * @brief 使用网卡发送一个数据包
+ * @brief 试图从网卡接收数据包
  * 
- * @param buf 要发送的数据包
+ * @param buf 收到的数据包
+ * @param netif 要接收的网卡
+ * @return int 数据包的长度，未收到为0，错误为-1
+ */
+int driver_recv(buf_t *buf, net_if_t *netif)
+{
+    if (driver_rx_rings)
+    {
+        ring_t *ring = &driver_rx_rings[netif - net_if_table];
+        driver_frame_t *frame = ring_dequeue_slot(ring);
+        if (frame == NULL)
+            return 0;
+        // 上层处理时移动了data，每个帧都要重新初始化
+        buf_init(buf, frame->len);
+        memcpy(buf->data, frame->data, frame->len);
+        ring_dequeue_commit(ring);
+        return buf->len;
+    }
+    const uint8_t *data;
+    int len = driver_recv_peek(netif, &data);
+    if (len > 0)
+    {
+        if (buf_init(buf, len) < 0)
+            return -1;
+        memcpy(buf->data, data, len);
+    }
+    return len;
+}
+#ifdef _WIN32
+/**
+ * @brief 内部函数，发出发送队列中的全部数据包
+ * 
+ * @return int 成功为0，失败为-1
+ */
+static int driver_sendqueue_flush()
+{
+    if (driver_sendqueue_num == 0)
+        return 0;
+    int ret = 0;
+    if (pcap_sendqueue_transmit(driver_sendqueue_pcap, driver_sendqueue, 0) < driver_sendqueue->len)
+    {
+        fprintf(stderr, "Error in pcap_sendqueue_transmit.\n%s.\n", pcap_geterr(driver_sendqueue_pcap));
+        ret = -1;
+    }
+    driver_sendqueue->len = 0;
+    driver_sendqueue_num = 0;
+    return ret;
+}
+#endif
+
+/**
+ * @brief 内部函数，从网卡发出一个帧，批量发送中且平台支持时进入发送队列
+ * 
+ * @param pcap 出口网卡的驱动句柄
+ * @param data 帧数据
+ * @param len 帧长
  * @return int 成功为0，失败为-1
  */
-int driver_send(buf_t *buf)
+static int driver_xmit(pcap_t *pcap, const uint8_t *data, size_t len)
 {
-    if (pcap_sendpacket(pcap, buf->data, buf->len) == -1)
+#ifdef _WIN32
+    int queue = driver_tx_deferred && len <= DRIVER_TX_FRAME_MAX;
+    // 队列只装发往同一网卡的数据包，换网卡或队列满时先发出，不进入队列的数据包也不能越过队列中的数据包
+    if (driver_sendqueue_num && (!queue || pcap != driver_sendqueue_pcap || driver_sendqueue_num == DRIVER_TX_BURST) &&
+        driver_sendqueue_flush() < 0)
+        return -1;
+    if (queue)
+    {
+        struct pcap_pkthdr pkt_hdr;
+        memset(&pkt_hdr, 0, sizeof(pkt_hdr));
+        pkt_hdr.caplen = pkt_hdr.len = len;
+        pcap_sendqueue_queue(driver_sendqueue, &pkt_hdr, data);
+        driver_sendqueue_pcap = pcap;
+        driver_sendqueue_num++;
+        return 0;
+    }
+#endif
+    if (pcap_sendpacket(pcap, data, len) == -1)
     {
         fprintf(stderr, "Error in driver_send.\n%s.\n", pcap_geterr(pcap));
         return -1;
     }
+    return 0;
+}
+
+/**
+ * @brief 使用网卡发送一个数据包
+ * 
+ * @param buf 要发送的数据包
+ * @param netif 出口网卡
+ * @return int 成功为0，失败为-1
+ */
+int driver_send(buf_t *buf, net_if_t *netif)
+{
+    if (driver_tx_ring)
+    {
+        if (buf->len > DRIVER_TX_FRAME_MAX)
+            return -1;
+        // 发送环满时让出处理器等待发送线程腾出槽位，发送线程停滞时丢弃该帧，不让协议处理线程一直空转
+        driver_frame_t *frame;
+        for (int spin = 0; (frame = ring_enqueue_slot(driver_tx_ring)) == NULL; spin++)
+        {
+            if (spin == PIPELINE_TX_SPIN)
+            {
+                if (driver_tx_dropped)
+                    __atomic_fetch_add(driver_tx_dropped, 1, __ATOMIC_RELAXED);
+                return -1;
+            }
+            sched_yield();
+        }
+        frame->netif = netif;
+        frame->len = buf->len;
+        memcpy(frame->data, buf->data, buf->len);
+        ring_enqueue_commit(driver_tx_ring);
+        return 0;
+    }
+    return driver_send_frame(netif, buf->data, buf->len);
+}
+
+/**
+ * @brief 从网卡直接发出一个已封装好的帧，不经过发送环，也不复制到txbuf
+ *        供流水线的发线程从发送环的槽位中直接发送
+ * 
+ * @param netif 出口网卡，须已在当前线程中持有驱动句柄
+ * @param data 帧数据
+ * @param len 帧长
+ * @return int 成功为0，失败为-1
+ */
+int driver_send_frame(net_if_t *netif, const uint8_t *data, size_t len)
+{
+    return driver_xmit(NET_IF_STATE(netif)->driver, data, len);
+}
 
+/**
+ * @brief 开始批量发送，之后driver_send发送的数据包进入发送队列
+ *        可以嵌套，如在net_poll的批量发送中再调用udp_send_batch，由最外层的driver_tx_flush发出
+ * 
+ */
+void driver_tx_begin()
+{
+    driver_tx_deferred++;
+}
+
+/**
+ * @brief 结束一层批量发送，最外层结束时发出发送队列中的全部数据包
+ * 
+ * @return int 成功为0，失败为-1
+ */
+int driver_tx_flush()
+{
+    if (driver_tx_deferred && --driver_tx_deferred)
+        return 0;
+#ifdef _WIN32
+    return driver_sendqueue_flush();
+#else
     return 0;
+#endif
 }
 /**
  * @brief 关闭网卡
  * 
+ * @param netif 要关闭的网卡
  */
-void driver_close()
+void driver_close(net_if_t *netif)
 {
-    pcap_close(pcap);
+    if (driver_rx_rings)
+        return;
+#ifdef _WIN32
+    if (driver_sendqueue_num && driver_sendqueue_pcap == NET_IF_STATE(netif)->driver)
+        driver_sendqueue_flush();
+#endif
+    pcap_close(NET_IF_STATE(netif)->driver);
+    NET_IF_STATE(netif)->driver = NULL;
+    driver_open_num--;
+#ifdef _WIN32
+    if (driver_open_num == 0)
+    {
+        pcap_sendqueue_destroy(driver_sendqueue);
+        driver_sendqueue = NULL;
+    }
+#endif
 }
@@ -7,18 +7,23 @@
  * @brief 处理一个收到的数据包
  *
  * @param buf 要处理的数据包
+ * @param netif 收到数据包的网卡
  */
-void ethernet_in(buf_t *buf)
+void ethernet_in(buf_t *buf, net_if_t *netif)
 {
     // TO-DO
 
     if (buf->len < 14)
     {
+        NET_IF_STATE(netif)->stats.rx_dropped++;
         return;
     }
     ether_hdr_t *hdr = (ether_hdr_t *)buf->data;
+    memset(&buf->meta, 0, sizeof(buf->meta));
+    buf->meta.rx_time_us = time_us();
+    buf->meta.l2_off = buf->data - buf->payload;
     buf_remove_header(buf, sizeof(ether_hdr_t));
-    net_in(buf, swap16(hdr->protocol16), hdr->src);
+    net_in(buf, swap16(hdr->protocol16), hdr->src, netif);
 }
 /**
  * @brief 处理一个要发送的数据包
@@ -26,8 +31,9 @@ void ethernet_in(buf_t *buf)
  * @param buf 要处理的数据包
  * @param mac 目标MAC地址
  * @param protocol 上层协议
+ * @param netif 出口网卡
  */
-void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
+void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol, net_if_t *netif)
 {
     // TO-DO
     // 如果buf的长度小于46，则向buf中添加填充
@@ -41,13 +47,32 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
     ether_hdr_t *hdr = (ether_hdr_t *)buf->data;
     // 将mac地址复制到hdr->dst中
     memcpy(hdr->dst, mac, sizeof(hdr->dst));
-    // 将NET_IF_MAC复制到hdr->src中
-    uint8_t src[NET_MAC_LEN] = NET_IF_MAC;
-    memcpy(hdr->src, src, sizeof(src));
+    // 将网卡mac地址复制到hdr->src中
+    memcpy(hdr->src, netif->mac, NET_MAC_LEN);
     // 将protocol转换为网络字节顺序
     hdr->protocol16 = swap16(protocol);
     // 将buf发送出去
-    driver_send(buf);
+    ethernet_send(buf, netif);
+}
+
+/**
+ * @brief 发送一个已填好以太网首部的帧，不足最小帧长时填充
+ *
+ * @param buf 要发送的帧
+ * @param netif 出口网卡
+ */
+void ethernet_send(buf_t *buf, net_if_t *netif)
+{
+    if (buf->len < sizeof(ether_hdr_t) + ETHERNET_MIN_TRANSPORT_UNIT)
+        buf_add_padding(buf, sizeof(ether_hdr_t) + ETHERNET_MIN_TRANSPORT_UNIT - buf->len);
+    if (driver_send(buf, netif) < 0)
+    {
+        NET_IF_STATE(netif)->stats.tx_errors++;
+        return;
+    }
+    net_if_stats_t *stats = &NET_IF_STATE(netif)->stats;
+    stats->tx_packets++;
+    stats->tx_bytes += buf->len;
 }
 /**
  * @brief 初始化以太网协议
@@ -61,9 +86,18 @@ void ethernet_init()
 /**
  * @brief 一次以太网轮询
  *
+ * @param netif 要轮询的网卡
+ * @return int 收到并处理了数据包为1，否则为0
  */
-void ethernet_poll()
+int ethernet_poll(net_if_t *netif)
 {
-    if (driver_recv(&rxbuf) > 0)
-        ethernet_in(&rxbuf);
+    if (driver_recv(&rxbuf, netif) > 0)
+    {
+        net_if_stats_t *stats = &NET_IF_STATE(netif)->stats;
+        stats->rx_packets++;
+        stats->rx_bytes += rxbuf.len;
+        ethernet_in(&rxbuf, netif);
+        return 1;
+    }
+    return 0;
 }
@@ -0,0 +1,87 @@
+#include <string.h>
+#include "hist.h"
+
+/**
+ * @brief 内部函数，计算值所在的桶
+ * 小于HIST_SUB_BUCKET_NUM的值各占一桶，更大的值按最高位所在的2的幂区间分组，组内再线性等分
+ *
+ * @param value 值
+ * @return size_t 桶下标
+ */
+static size_t hist_index(uint64_t value)
+{
+    if (value < HIST_SUB_BUCKET_NUM)
+        return value;
+    int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_BUCKET_NUM + (value >> shift) - HIST_SUB_BUCKET_NUM;
+}
+
+/**
+ * @brief 内部函数，计算桶内的最大值
+ *
+ * @param index 桶下标
+ * @return uint64_t 落入该桶的最大值
+ */
+static uint64_t hist_bucket_max(size_t index)
+{
+    if (index < HIST_SUB_BUCKET_NUM)
+        return index;
+    int shift = index / HIST_SUB_BUCKET_NUM - 1;
+    uint64_t lower = (uint64_t)(index % HIST_SUB_BUCKET_NUM + HIST_SUB_BUCKET_NUM) << shift;
+    return lower + ((uint64_t)1 << shift) - 1;
+}
+
+/**
+ * @brief 初始化直方图
+ *
+ * @param hist 要初始化的直方图
+ */
+void hist_init(hist_t *hist)
+{
+    memset(hist, 0, sizeof(hist_t));
+    hist->min = UINT64_MAX;
+}
+
+/**
+ * @brief 记录一个值
+ *
+ * @param hist 直方图
+ * @param value 值
+ */
+void hist_record(hist_t *hist, uint64_t value)
+{
+    hist->counts[hist_index(value)]++;
+    hist->total++;
+    hist->sum += value;
+    if (value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+/**
+ * @brief 查询百分位数
+ *
+ * @param hist 直方图
+ * @param percentile 百分位，如99.9
+ * @return uint64_t 不小于该比例的值的上界，直方图为空时为0
+ */
+uint64_t hist_percentile(hist_t *hist, double percentile)
+{
+    if (hist->total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(percentile / 100 * hist->total + 0.5);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HIST_BUCKET_NUM; i++)
+    {
+        seen += hist->counts[i];
+        if (seen >= rank)
+        {
+            uint64_t value = hist_bucket_max(i);
+            return value > hist->max ? hist->max : value;
+        }
+    }
+    return hist->max;
+}
@@ -1,6 +1,49 @@
 #include "net.h"
 #include "icmp.h"
 #include "ip.h"
+#include "ethernet.h"
+#include "udp.h"
+
+/**
+ * @brief icmp统计
+ *
+ */
+NET_TLS icmp_stats_t icmp_stats;
+
+/**
+ * @brief 全局令牌桶，限制icmp差错与回显响应的总速率
+ *
+ */
+static NET_TLS token_bucket_t icmp_bucket;
+
+/**
+ * @brief 按目的地址限速的令牌桶，地址按哈希映射，冲突的地址共用一个桶，不会因换地址而重新得到突发额度
+ *
+ */
+static NET_TLS token_bucket_t icmp_src_buckets[ICMP_SRC_BUCKET_NUM];
+
+/**
+ * @brief 当前的ping会话
+ *
+ */
+NET_TLS icmp_ping_t icmp_ping_session;
+
+/**
+ * @brief 内部函数，为发往某地址的icmp报文取令牌，端口扫描或洪泛时丢弃报文而不是耗尽处理能力
+ *
+ * @param dst_ip 报文的目的地址，即触发报文的源地址
+ * @return int 允许发送为1，被限速为0
+ */
+static int icmp_rate_allow(uint8_t *dst_ip)
+{
+    static const uint8_t zero_ip[NET_IP_LEN] = {0};
+    uint64_t now = time_us();
+    size_t slot = flow_hash(dst_ip, zero_ip, NET_PROTOCOL_ICMP, 0, 0) % ICMP_SRC_BUCKET_NUM;
+    if (token_bucket_take(&icmp_src_buckets[slot], now) && token_bucket_take(&icmp_bucket, now))
+        return 1;
+    icmp_stats.rate_limited++;
+    return 0;
+}
 
 /**
  * @brief 发送icmp响应
@@ -33,13 +76,85 @@ static void icmp_resp(buf_t *req_buf, uint8_t *src_ip)
     ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
 }
 
+/**
+ * @brief 内部函数，把收到的回显请求帧就地改为回显响应，原路发回请求方的mac地址
+ * 交换地址不改变校验和，只需为TTL与类型增量更新，不拷贝负载，也不查路由与arp表
+ *
+ * @param req_buf 收到的icmp请求包，其前面紧邻无选项的ip首部与以太网首部
+ * @param netif 收到请求的网卡
+ */
+static void icmp_resp_in_place(buf_t *req_buf, net_if_t *netif)
+{
+    icmp_hdr_t *icmp_hdr = (icmp_hdr_t *)req_buf->data;
+    buf_add_header(req_buf, sizeof(ip_hdr_t));
+    ip_hdr_t *ip_hdr = (ip_hdr_t *)req_buf->data;
+    ether_hdr_t *ether_hdr = (ether_hdr_t *)(req_buf->data - sizeof(ether_hdr_t));
+
+    // 交换源和目的ip地址
+    uint8_t ip[NET_IP_LEN];
+    memcpy(ip, ip_hdr->src_ip, NET_IP_LEN);
+    memcpy(ip_hdr->src_ip, ip_hdr->dst_ip, NET_IP_LEN);
+    memcpy(ip_hdr->dst_ip, ip, NET_IP_LEN);
+    // 重置TTL，TTL与协议号同属一个16位字
+    uint16_t old_word = (ip_hdr->ttl << 8) | ip_hdr->protocol;
+    ip_hdr->ttl = IP_DEFALUT_TTL;
+    ip_hdr->hdr_checksum16 = swap16(checksum16_update(swap16(ip_hdr->hdr_checksum16), old_word, (ip_hdr->ttl << 8) | ip_hdr->protocol));
+
+    // 类型改为回显响应，类型与代码同属一个16位字
+    old_word = (icmp_hdr->type << 8) | icmp_hdr->code;
+    icmp_hdr->type = ICMP_TYPE_ECHO_REPLY;
+    icmp_hdr->code = 0;
+    icmp_hdr->checksum16 = swap16(checksum16_update(swap16(icmp_hdr->checksum16), old_word, ICMP_TYPE_ECHO_REPLY << 8));
+
+    // ethernet_out原地重写以太网首部，请求的源mac即响应的目的mac
+    ethernet_out(req_buf, ether_hdr->src, NET_PROTOCOL_IP, netif);
+}
+
+/**
+ * @brief 内部函数，为不填写下一跳mtu的旧式路由器估计路径mtu，取小于原数据包长度的最大常见mtu（RFC 1191）
+ *
+ * @param orig_len 被丢弃的原数据包长度
+ * @return uint16_t 估计的路径mtu
+ */
+static uint16_t icmp_pmtu_plateau(uint16_t orig_len)
+{
+    static const uint16_t plateaus[] = {32000, 17914, 8166, 4352, 2002, 1492, 1006, 508, 296};
+    for (size_t i = 0; i < sizeof(plateaus) / sizeof(plateaus[0]); i++)
+        if (plateaus[i] < orig_len)
+            return plateaus[i];
+    return IP_PMTU_MIN;
+}
+
+/**
+ * @brief 内部函数，将回显响应与未决的ping请求匹配并记录往返时间
+ *
+ * @param hdr 收到的回显响应
+ * @param src_ip 源ip地址
+ */
+static void icmp_ping_reply(icmp_hdr_t *hdr, uint8_t *src_ip)
+{
+    icmp_ping_t *ping = &icmp_ping_session;
+    uint16_t seq = swap16(hdr->seq16);
+    // 只接受本会话、已发出且仍在窗口内的序号，重复的响应因发送时间已清零而被忽略
+    if (!ping->active || swap16(hdr->id16) != ping->id || memcmp(src_ip, ping->dst_ip, NET_IP_LEN) ||
+        seq >= ping->sent || ping->sent - seq > ICMP_PING_WINDOW)
+        return;
+    uint64_t *send_us = &ping->send_us[seq % ICMP_PING_WINDOW];
+    if (*send_us == 0)
+        return;
+    hist_record(&ping->rtt, time_us() - *send_us);
+    *send_us = 0;
+    ping->received++;
+}
+
 /**
  * @brief 处理一个收到的数据包
  *
  * @param buf 要处理的数据包
  * @param src_ip 源ip地址
+ * @param netif 收到数据包的网卡
  */
-void icmp_in(buf_t *buf, uint8_t *src_ip)
+void icmp_in(buf_t *buf, uint8_t *src_ip, net_if_t *netif)
 {
     // head check
     if (buf->len < sizeof(icmp_hdr_t))
@@ -49,21 +164,69 @@ void icmp_in(buf_t *buf, uint8_t *src_ip)
 
     if (hdr->type == ICMP_TYPE_ECHO_REQUEST)
     {
-        icmp_resp(buf, src_ip);
+        if (!icmp_rate_allow(src_ip))
+            return;
+        icmp_stats.echo_replies++;
+        // 带选项或是分片的请求无法原地改写：响应须有新的id与分片标志，校验和也须覆盖整个数据报，走ip_out的完整路径
+        ip_hdr_t *ip_hdr = (ip_hdr_t *)(buf->data - sizeof(ip_hdr_t));
+        if (ip_hdr->hdr_len == sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE &&
+            !(swap16(ip_hdr->flags_fragment16) & (IP_MORE_FRAGMENT | IP_FRAGMENT_OFFSET_MASK)))
+            icmp_resp_in_place(buf, netif);
+        else
+            icmp_resp(buf, src_ip);
+    }
+    else if (hdr->type == ICMP_TYPE_ECHO_REPLY)
+    {
+        icmp_ping_reply(hdr, src_ip);
+    }
+    else if (hdr->type == ICMP_TYPE_UNREACH && buf->len >= sizeof(icmp_hdr_t) + sizeof(ip_hdr_t))
+    {
+        // 只处理引用了本机发出的原数据包的报文
+        ip_hdr_t *orig_hdr = (ip_hdr_t *)(buf->data + sizeof(icmp_hdr_t));
+        if (orig_hdr->version != IP_VERSION_4 || !net_if_find(orig_hdr->src_ip))
+            return;
+        uint8_t code = hdr->code;
+        // 降低到原目的地址的路径mtu
+        if (code == ICMP_CODE_FRAG_NEEDED)
+        {
+            uint16_t mtu = swap16(hdr->seq16);
+            if (mtu == 0)
+                mtu = icmp_pmtu_plateau(swap16(orig_hdr->total_len16));
+            ip_pmtu_update(orig_hdr->dst_ip, mtu);
+        }
+        // 通知发出原数据报的udp端口
+        if (orig_hdr->protocol == NET_PROTOCOL_UDP)
+        {
+            buf_remove_header(buf, sizeof(icmp_hdr_t));
+            udp_err_in(buf, code);
+        }
     }
 }
 
 /**
- * @brief 发送icmp不可达
+ * @brief 发送icmp差错报文，携带原数据包的ip首部与前8字节
  *
  * @param recv_buf 收到的ip数据包
  * @param src_ip 源ip地址
- * @param code icmp code，协议不可达或端口不可达
+ * @param type icmp type
+ * @param code icmp code
+ * @param mtu 下一跳mtu，仅用于需要分片报文，其他为0
  */
-void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
+static void icmp_error(buf_t *recv_buf, uint8_t *src_ip, icmp_type_t type, icmp_code_t code, uint16_t mtu)
 {
     // 定义一个指向接收缓冲区的指针
     uint8_t *data = recv_buf->data;
+    // 不为icmp差错报文再产生差错报文，避免差错报文风暴
+    ip_hdr_t *ip_hdr = (ip_hdr_t *)data;
+    if (ip_hdr->protocol == NET_PROTOCOL_ICMP && recv_buf->len >= ip_hdr->hdr_len * IP_HDR_LEN_PER_BYTE + sizeof(icmp_hdr_t))
+    {
+        uint8_t recv_type = ((icmp_hdr_t *)(data + ip_hdr->hdr_len * IP_HDR_LEN_PER_BYTE))->type;
+        if (recv_type != ICMP_TYPE_ECHO_REQUEST && recv_type != ICMP_TYPE_ECHO_REPLY)
+            return;
+    }
+    if (!icmp_rate_allow(src_ip))
+        return;
+    icmp_stats.errors++;
     // 计算总大小
     int total_size = sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 8;
     // 获取IP头部的长度
@@ -80,11 +243,11 @@ void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
     icmp_hdr_t *hdr = (icmp_hdr_t *)txbuf.data;
     // 设置ICMP头部的类型、代码、校验和等参数
     *hdr = (icmp_hdr_t){
-        .type = ICMP_TYPE_UNREACH,
+        .type = type,
         .code = code,
         .checksum16 = 0,
         .id16 = 0,
-        .seq16 = 0,
+        .seq16 = swap16(mtu),
     };
     // 将ICMP头部的校验和设置为接收缓冲区数据的校验和
     hdr->checksum16 = swap16(checksum16((uint16_t *)txbuf.data, total_size));
@@ -93,11 +256,135 @@ void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
     ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
 }
 
+/**
+ * @brief 发送icmp不可达
+ *
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ * @param code icmp code，网络不可达、协议不可达或端口不可达
+ */
+void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
+{
+    icmp_error(recv_buf, src_ip, ICMP_TYPE_UNREACH, code, 0);
+}
+
+/**
+ * @brief 发送icmp超时，用于转发时TTL耗尽
+ *
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ */
+void icmp_time_exceeded(buf_t *recv_buf, uint8_t *src_ip)
+{
+    icmp_error(recv_buf, src_ip, ICMP_TYPE_TIME_EXCEEDED, ICMP_CODE_TTL_EXCEEDED, 0);
+}
+
+/**
+ * @brief 发送icmp需要分片，用于转发时置DF位的数据包超过出口mtu
+ *
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ * @param mtu 出口网卡的mtu
+ */
+void icmp_frag_needed(buf_t *recv_buf, uint8_t *src_ip, uint16_t mtu)
+{
+    icmp_error(recv_buf, src_ip, ICMP_TYPE_UNREACH, ICMP_CODE_FRAG_NEEDED, mtu);
+}
+
+/**
+ * @brief 开始一次ping，之后由net_poll按间隔发送请求并收集往返时间
+ *
+ * @param dst_ip 目的ip地址
+ * @param count 请求数
+ * @param interval_ms 发送间隔，毫秒
+ * @param size 每个请求的数据长度
+ * @return int 成功为0，已有ping在进行、无路由或长度过大为-1
+ */
+int icmp_ping(uint8_t *dst_ip, uint16_t count, uint32_t interval_ms, uint16_t size)
+{
+    icmp_ping_t *ping = &icmp_ping_session;
+    if (ping->active || count == 0 || ip_mtu(dst_ip) == 0 ||
+        size > UINT16_MAX - sizeof(ip_hdr_t) - sizeof(icmp_hdr_t))
+        return -1;
+    static NET_TLS uint16_t ping_id = 0;
+    if (ping_id == 0)
+        ping_id = (uint16_t)time_us();
+    memcpy(ping->dst_ip, dst_ip, NET_IP_LEN);
+    ping->id = ping_id++;
+    ping->count = count;
+    ping->sent = ping->received = 0;
+    ping->interval_ms = interval_ms;
+    ping->size = size;
+    ping->next_us = time_us();
+    memset(ping->send_us, 0, sizeof(ping->send_us));
+    hist_init(&ping->rtt);
+    ping->active = 1;
+    return 0;
+}
+
+/**
+ * @brief 推进ping会话，到时间则发出下一个请求，全部应答或超时后结束会话
+ *
+ */
+void icmp_ping_poll()
+{
+    icmp_ping_t *ping = &icmp_ping_session;
+    if (!ping->active)
+        return;
+    uint64_t now = time_us();
+    if (ping->sent == ping->count)
+    {
+        if (ping->received == ping->count || now >= ping->next_us)
+            ping->active = 0;
+        return;
+    }
+    if (now < ping->next_us)
+        return;
+
+    buf_init(&txbuf, sizeof(icmp_hdr_t) + ping->size);
+    icmp_hdr_t *hdr = (icmp_hdr_t *)txbuf.data;
+    *hdr = (icmp_hdr_t){
+        .type = ICMP_TYPE_ECHO_REQUEST,
+        .code = 0,
+        .checksum16 = 0,
+        .id16 = swap16(ping->id),
+        .seq16 = swap16(ping->sent),
+    };
+    for (size_t i = 0; i < ping->size; i++)
+        txbuf.data[sizeof(icmp_hdr_t) + i] = i;
+    hdr->checksum16 = swap16(checksum16((uint16_t *)txbuf.data, txbuf.len));
+    ping->send_us[ping->sent % ICMP_PING_WINDOW] = now;
+    ping->sent++;
+    // 最后一个请求发出后，next_us改为等待响应的截止时间
+    ping->next_us = ping->sent == ping->count ? now + ICMP_PING_TIMEOUT_MS * 1000 : ping->next_us + (uint64_t)ping->interval_ms * 1000;
+    ip_out(&txbuf, ping->dst_ip, NET_PROTOCOL_ICMP);
+}
+
+/**
+ * @brief 打印ping的统计结果
+ *
+ */
+void icmp_ping_print()
+{
+    icmp_ping_t *ping = &icmp_ping_session;
+    hist_t *rtt = &ping->rtt;
+    printf("--- %s ping statistics ---\n", iptos(ping->dst_ip));
+    printf("%u packets transmitted, %u received, %.1f%% packet loss\n", ping->sent, ping->received,
+           ping->sent ? 100.0 * (ping->sent - ping->received) / ping->sent : 0.0);
+    if (rtt->total)
+        printf("rtt min/avg/max = %.3f/%.3f/%.3f ms, p50/p99/p999 = %.3f/%.3f/%.3f ms\n",
+               rtt->min / 1000.0, (double)rtt->sum / rtt->total / 1000.0, rtt->max / 1000.0,
+               hist_percentile(rtt, 50) / 1000.0, hist_percentile(rtt, 99) / 1000.0, hist_percentile(rtt, 99.9) / 1000.0);
+}
+
 /**
  * @brief 初始化icmp协议
  *
  */
 void icmp_init()
 {
+    token_bucket_init(&icmp_bucket, ICMP_RATE_LIMIT, ICMP_RATE_BURST);
+    for (size_t i = 0; i < ICMP_SRC_BUCKET_NUM; i++)
+        token_bucket_init(&icmp_src_buckets[i], ICMP_SRC_RATE_LIMIT, ICMP_SRC_RATE_BURST);
     net_add_protocol(NET_PROTOCOL_ICMP, icmp_in);
 }
\ No newline at end of file
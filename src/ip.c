@@ -3,14 +3,172 @@
 #include "ethernet.h"
 #include "arp.h"
 #include "icmp.h"
+#include "route.h"
+
+/**
+ * @brief 是否开启ip转发
+ *
+ */
+static int ip_forwarding = IP_FORWARD_DEFAULT;
+
+/**
+ * @brief ip转发统计
+ *
+ */
+NET_TLS ip_forward_stats_t ip_forward_stats;
+
+/**
+ * @brief 路径mtu缓存，由icmp需要分片报文更新，expire为0的项未使用
+ *        满时覆盖最早写入的项，过期的项在查找时清除
+ *
+ */
+static NET_TLS struct
+{
+    uint8_t ip[NET_IP_LEN]; // 目的ip地址
+    uint16_t mtu;           // 路径mtu
+    time_t expire;          // 过期时间
+    uint32_t serial;        // 写入序号，越小越早
+} ip_pmtu_cache[IP_PMTU_MAX_NUM];
+static NET_TLS size_t ip_pmtu_num;         //有效项数
+static NET_TLS time_t ip_pmtu_next_expire; //有效项中最早的过期时间
+static NET_TLS uint32_t ip_pmtu_serial;    //下一次写入的序号
+
+/**
+ * @brief 路径mtu缓存版本，每次降低路径mtu或有项过期加1
+ *
+ */
+static NET_TLS uint32_t ip_pmtu_generation;
+
+/**
+ * @brief 路由表是否已建立
+ *
+ */
+static int ip_route_built;
+
+/**
+ * @brief 数据包id
+ *
+ */
+static NET_TLS uint16_t ip_id = 0;
+
+/**
+ * @brief 开启或关闭ip转发，开启后非本机的数据包将被转发而不是丢弃
+ *
+ * @param enable 1为开启，0为关闭
+ */
+void ip_forward_enable(int enable)
+{
+    ip_forwarding = enable;
+}
+
+/**
+ * @brief 内部函数，把超过出口mtu且未置DF位的转发数据包分片发出
+ *        各分片沿用原首部，只改写总长度、分片标志与校验和，原数据包本身是分片时偏移在其基础上累加
+ *
+ * @param buf 要转发的数据包，data指向ip首部，TTL已减1
+ * @param mtu 出口网卡mtu
+ * @param next_hop 下一跳ip地址
+ * @param netif 出口网卡
+ */
+static void ip_forward_fragments(buf_t *buf, uint16_t mtu, uint8_t *next_hop, net_if_t *netif)
+{
+    ip_hdr_t *ip_hdr = (ip_hdr_t *)buf->data;
+    size_t hdr_len = ip_hdr->hdr_len * IP_HDR_LEN_PER_BYTE;
+    uint16_t flags = swap16(ip_hdr->flags_fragment16);
+    // 分片长度取出口mtu，并向下对齐到分片偏移单位
+    size_t frag_len = mtu > hdr_len ? (mtu - hdr_len) / IP_HDR_OFFSET_PER_BYTE * IP_HDR_OFFSET_PER_BYTE : 0;
+    if (frag_len == 0)
+        return;
+    buf_t ip_buf;
+    for (size_t off = hdr_len; off < buf->len; off += frag_len)
+    {
+        size_t len = buf->len - off < frag_len ? buf->len - off : frag_len;
+        buf_init(&ip_buf, hdr_len + len);
+        memcpy(ip_buf.data, buf->data, hdr_len);
+        memcpy(ip_buf.data + hdr_len, buf->data + off, len);
+        ip_hdr_t *hdr = (ip_hdr_t *)ip_buf.data;
+        // 最后一个分片沿用原数据包的MF位
+        int mf = off + len < buf->len || (flags & IP_MORE_FRAGMENT);
+        hdr->total_len16 = swap16(hdr_len + len);
+        hdr->flags_fragment16 = swap16((mf ? IP_MORE_FRAGMENT : 0) | ((flags & IP_FRAGMENT_OFFSET_MASK) + (off - hdr_len) / IP_HDR_OFFSET_PER_BYTE));
+        hdr->hdr_checksum16 = 0;
+        hdr->hdr_checksum16 = swap16(checksum16((uint16_t *)hdr, hdr_len));
+        arp_out(&ip_buf, next_hop, netif);
+    }
+}
+
+/**
+ * @brief 转发一个不是发给本机的数据包
+ *
+ * @param buf 要转发的数据包，data指向ip首部
+ */
+static void ip_forward(buf_t *buf)
+{
+    ip_hdr_t *ip_hdr = (ip_hdr_t *)buf->data;
+    // 受限广播与组播只在本链路内有效，不转发
+    if ((ip_hdr->dst_ip[0] & 0xF0) == 0xE0 ||
+        (ip_hdr->dst_ip[0] == 255 && ip_hdr->dst_ip[1] == 255 && ip_hdr->dst_ip[2] == 255 && ip_hdr->dst_ip[3] == 255))
+    {
+        ip_forward_stats.not_forwardable++;
+        return;
+    }
+    if (ip_hdr->ttl <= 1)
+    {
+        ip_forward_stats.ttl_exceeded++;
+        icmp_time_exceeded(buf, ip_hdr->src_ip);
+        return;
+    }
+
+    // 分片可能不含端口，分片的数据包只按地址选路，保证同一数据包的分片走同一网关
+    uint16_t src_port = 0, dst_port = 0;
+    size_t hdr_len = ip_hdr->hdr_len * IP_HDR_LEN_PER_BYTE;
+    if ((ip_hdr->protocol == NET_PROTOCOL_UDP || ip_hdr->protocol == NET_PROTOCOL_TCP) &&
+        !(swap16(ip_hdr->flags_fragment16) & (IP_MORE_FRAGMENT | IP_FRAGMENT_OFFSET_MASK)) &&
+        buf->len >= hdr_len + 2 * sizeof(uint16_t))
+    {
+        src_port = (buf->data[hdr_len] << 8) | buf->data[hdr_len + 1];
+        dst_port = (buf->data[hdr_len + 2] << 8) | buf->data[hdr_len + 3];
+    }
+    route_t *route = route_lookup(ip_hdr->dst_ip);
+    if (route == NULL)
+    {
+        ip_forward_stats.no_route++;
+        icmp_unreachable(buf, ip_hdr->src_ip, ICMP_CODE_NET_UNREACH);
+        return;
+    }
+    // 超过出口网卡mtu的数据包与本机发出的一样分片，置DF位的丢弃并告知源端需要分片，以便其调整路径mtu
+    int too_big = buf->len > route->netif->mtu;
+    if (too_big && (swap16(ip_hdr->flags_fragment16) & IP_DONT_FRAGMENT))
+    {
+        ip_forward_stats.too_big++;
+        icmp_frag_needed(buf, ip_hdr->src_ip, route->netif->mtu);
+        return;
+    }
+    uint8_t *next_hop = route_next_hop(route, ip_hdr->dst_ip, flow_hash(ip_hdr->src_ip, ip_hdr->dst_ip, ip_hdr->protocol, src_port, dst_port));
+
+    // TTL与协议号同属一个16位字，TTL减1后增量更新首部校验和
+    uint16_t old_word = (ip_hdr->ttl << 8) | ip_hdr->protocol;
+    ip_hdr->ttl--;
+    uint16_t new_word = (ip_hdr->ttl << 8) | ip_hdr->protocol;
+    ip_hdr->hdr_checksum16 = swap16(checksum16_update(swap16(ip_hdr->hdr_checksum16), old_word, new_word));
+    ip_forward_stats.forwarded++;
+    if (too_big)
+    {
+        ip_forward_stats.fragmented++;
+        ip_forward_fragments(buf, route->netif->mtu, next_hop, route->netif);
+    }
+    else
+        arp_out(buf, next_hop, route->netif);
+}
 
 /**
  * @brief 处理一个收到的数据包
  *
  * @param buf 要处理的数据包
  * @param src_mac 源mac地址
+ * @param netif 收到数据包的网卡
  */
-void ip_in(buf_t *buf, uint8_t *src_mac)
+void ip_in(buf_t *buf, uint8_t *src_mac, net_if_t *netif)
 {
     // TO-DO
     // 长度检测
@@ -34,21 +192,29 @@ void ip_in(buf_t *buf, uint8_t *src_mac)
     }
     // 恢复校验和
     ip_hdr->hdr_checksum16 = checksum;
-    // 丢弃非本机IP的包
-    if (memcmp(net_if_ip, ip_hdr->dst_ip, NET_IP_LEN) != 0)
+    buf->meta.l3_off = buf->data - buf->payload;
+    memcpy(buf->meta.src_ip, ip_hdr->src_ip, NET_IP_LEN);
+    memcpy(buf->meta.dst_ip, ip_hdr->dst_ip, NET_IP_LEN);
+    buf->meta.protocol = ip_hdr->protocol;
+    buf->meta.csum |= BUF_CSUM_L3;
+    if (buf->len > swap16(ip_hdr->total_len16))
+        buf_remove_padding(buf, buf->len - swap16(ip_hdr->total_len16));
+    // 目的地址不属于本机任何网卡的包，开启转发时转发，否则丢弃
+    if (net_if_find(ip_hdr->dst_ip) == NULL)
     {
+        if (ip_forwarding)
+            ip_forward(buf);
         return;
     }
-    if (buf->len > swap16(ip_hdr->total_len16))
-        buf_remove_padding(buf, buf->len - swap16(ip_hdr->total_len16));
     // 不能识别的协议类型返回不可达
     if (!(ip_hdr->protocol == NET_PROTOCOL_UDP ||
+          ip_hdr->protocol == NET_PROTOCOL_UDPLITE ||
           ip_hdr->protocol == NET_PROTOCOL_ICMP))
     {
         icmp_unreachable(buf, ip_hdr->src_ip, ICMP_CODE_PROTOCOL_UNREACH);
     }
     buf_remove_header(buf, sizeof(ip_hdr_t));
-    net_in(buf, ip_hdr->protocol, ip_hdr->src_ip);
+    net_in(buf, ip_hdr->protocol, ip_hdr->src_ip, netif);
 }
 
 /**
@@ -60,8 +226,11 @@ void ip_in(buf_t *buf, uint8_t *src_mac)
  * @param id 数据包id
  * @param offset 分片offset，必须被8整除
  * @param mf 分片mf标志，是否有下一个分片
+ * @param df DF标志，是否禁止路径上的路由器分片
+ * @param next_hop 下一跳ip地址
+ * @param netif 出口网卡
  */
-void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
+void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf, int df, uint8_t *next_hop, net_if_t *netif)
 {
     // TO-DO
 
@@ -76,41 +245,152 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
     if (mf)
     {
         // 当存在下一分片时，标志位为001
-        packet.flags_fragment16 = swap16(0x2000 | offset);
+        packet.flags_fragment16 = swap16(IP_MORE_FRAGMENT | offset);
     }
     else
     {
-        // 不存在下一分片时，标志位为000
-        packet.flags_fragment16 = swap16(offset);
+        // 不存在下一分片时，标志位为000，禁止分片时为010
+        packet.flags_fragment16 = swap16((df ? IP_DONT_FRAGMENT : 0) | offset);
     }
     packet.protocol = protocol;
     packet.ttl = IP_DEFALUT_TTL;
     // 先将校验和置0以运算校验和
     packet.hdr_checksum16 = swap16(0);
     memcpy(packet.dst_ip, ip, NET_IP_LEN);
-    memcpy(packet.src_ip, net_if_ip, NET_IP_LEN);
+    memcpy(packet.src_ip, net_if_src_ip(netif, ip), NET_IP_LEN);
     packet.hdr_checksum16 = swap16(checksum16((uint16_t *)(&packet), sizeof(ip_hdr_t)));
     buf_add_header(buf, sizeof(ip_hdr_t));
     memcpy(buf->data, &packet, sizeof(ip_hdr_t));
-    arp_out(buf, ip);
+    arp_out(buf, next_hop, netif);
 }
 
 /**
- * @brief 处理一个要发送的ip数据包
+ * @brief 内部函数，清除路径mtu缓存中过期的项，有项过期时使已解析的路径失效，以恢复按网卡mtu发送
+ *
+ */
+static void ip_pmtu_expire()
+{
+    if (ip_pmtu_num == 0)
+        return;
+    time_t now = time(NULL);
+    if (now < ip_pmtu_next_expire)
+        return;
+    ip_pmtu_next_expire = 0;
+    for (size_t i = 0; i < IP_PMTU_MAX_NUM; i++)
+    {
+        if (!ip_pmtu_cache[i].expire)
+            continue;
+        if (ip_pmtu_cache[i].expire <= now)
+        {
+            ip_pmtu_cache[i].expire = 0;
+            ip_pmtu_num--;
+        }
+        else if (!ip_pmtu_next_expire || ip_pmtu_cache[i].expire < ip_pmtu_next_expire)
+            ip_pmtu_next_expire = ip_pmtu_cache[i].expire;
+    }
+    ip_pmtu_generation++;
+}
+
+/**
+ * @brief 内部函数，获取命中路由的目的地址的路径mtu
+ *
+ * @param route 目的地址命中的路由
+ * @param dst_ip 目的ip地址
+ * @return uint16_t 出口网卡mtu与缓存的路径mtu中较小者
+ */
+static uint16_t ip_route_mtu(route_t *route, uint8_t *dst_ip)
+{
+    // 没有收到过需要分片报文时缓存为空，不必查找
+    ip_pmtu_expire();
+    for (size_t i = 0; ip_pmtu_num && i < IP_PMTU_MAX_NUM; i++)
+        if (ip_pmtu_cache[i].expire && !memcmp(ip_pmtu_cache[i].ip, dst_ip, NET_IP_LEN))
+            return ip_pmtu_cache[i].mtu < route->netif->mtu ? ip_pmtu_cache[i].mtu : route->netif->mtu;
+    return route->netif->mtu;
+}
+
+/**
+ * @brief 获取到目的地址的路径mtu，不超过该长度的ip数据包不会被分片
+ *
+ * @param dst_ip 目的ip地址
+ * @return uint16_t 路径mtu，无路由为0
+ */
+uint16_t ip_mtu(uint8_t *dst_ip)
+{
+    route_t *route = route_lookup(dst_ip);
+    return route ? ip_route_mtu(route, dst_ip) : 0;
+}
+
+/**
+ * @brief 根据icmp需要分片报文降低到目的地址的路径mtu，只降不升，过期后恢复
+ *
+ * @param dst_ip 目的ip地址
+ * @param mtu 报文给出的下一跳mtu
+ */
+void ip_pmtu_update(uint8_t *dst_ip, uint16_t mtu)
+{
+    if (mtu < IP_PMTU_MIN)
+        mtu = IP_PMTU_MIN;
+    uint16_t now = ip_mtu(dst_ip);
+    if (now == 0 || mtu >= now)
+        return;
+    // 沿用该地址已有的项，否则取空闲项，都没有时覆盖最早写入的项
+    size_t slot = IP_PMTU_MAX_NUM;
+    for (size_t i = 0; i < IP_PMTU_MAX_NUM; i++)
+    {
+        if (ip_pmtu_cache[i].expire && !memcmp(ip_pmtu_cache[i].ip, dst_ip, NET_IP_LEN))
+        {
+            slot = i;
+            break;
+        }
+        if (slot == IP_PMTU_MAX_NUM ||
+            (ip_pmtu_cache[slot].expire && (!ip_pmtu_cache[i].expire || (int32_t)(ip_pmtu_cache[i].serial - ip_pmtu_cache[slot].serial) < 0)))
+            slot = i;
+    }
+    if (!ip_pmtu_cache[slot].expire)
+        ip_pmtu_num++;
+    memcpy(ip_pmtu_cache[slot].ip, dst_ip, NET_IP_LEN);
+    ip_pmtu_cache[slot].mtu = mtu;
+    ip_pmtu_cache[slot].expire = time(NULL) + IP_PMTU_TIMEOUT_SEC;
+    ip_pmtu_cache[slot].serial = ip_pmtu_serial++;
+    if (!ip_pmtu_next_expire || ip_pmtu_cache[slot].expire < ip_pmtu_next_expire)
+        ip_pmtu_next_expire = ip_pmtu_cache[slot].expire;
+    ip_pmtu_generation++;
+}
+
+/**
+ * @brief 内部函数，发送一个ip数据包，超过路径mtu时分片
  *
  * @param buf 要处理的包
  * @param ip 目标ip地址
  * @param protocol 上层协议
+ * @param df 是否置DF位，置位时超过路径mtu的数据包被丢弃而不分片
+ * @return int 成功为0，无路由或超过路径mtu为-1
  */
-void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+static int ip_output(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int df)
 {
-    // TO-DO
-    static uint16_t ip_id = 0;
+    // 先解析下一跳，无路由的数据包直接丢弃，避免无意义的arp请求
+    // 下一跳按五元组选择，同一数据包的所有分片也走同一网关
+    uint16_t src_port = 0, dst_port = 0;
+    if ((protocol == NET_PROTOCOL_UDP || protocol == NET_PROTOCOL_TCP) && buf->len >= 2 * sizeof(uint16_t))
+    {
+        src_port = (buf->data[0] << 8) | buf->data[1];
+        dst_port = (buf->data[2] << 8) | buf->data[3];
+    }
+    route_t *route = route_lookup(ip);
+    if (route == NULL)
+        return -1;
+    net_if_t *netif = route->netif;
+    uint16_t mtu = ip_route_mtu(route, ip);
+    if (df && buf->len + sizeof(ip_hdr_t) > mtu)
+        return -1;
+    uint8_t *next_hop = route_next_hop(route, ip, flow_hash(net_if_src_ip(netif, ip), ip, protocol, src_port, dst_port));
+    // 分片长度取路径mtu，并向下对齐到分片偏移单位
+    size_t frag_len = (mtu - sizeof(ip_hdr_t)) / IP_HDR_OFFSET_PER_BYTE * IP_HDR_OFFSET_PER_BYTE;
 
-    // 数据长度小于1480直接发送
-    if (buf->len <= ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t))
+    // 整个数据包不超过路径mtu直接发送
+    if (buf->len + sizeof(ip_hdr_t) <= mtu)
     {
-        ip_fragment_out(buf, ip, protocol, ip_id, 0, 0);
+        ip_fragment_out(buf, ip, protocol, ip_id, 0, 0, df, next_hop, netif);
         ip_id += 1;
     }
     else
@@ -118,14 +398,14 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
         buf_t ip_buf;
         uint16_t len_sum = 0;
 
-        // 每次分割1480长度的切片
-        while (buf->len > ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t))
+        // 每次分割frag_len长度的切片
+        while (buf->len > frag_len)
         {
-            buf_init(&ip_buf, ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t));
-            memcpy(ip_buf.data, buf->data, ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t));
-            ip_fragment_out(&ip_buf, ip, protocol, ip_id, len_sum / IP_HDR_OFFSET_PER_BYTE, 1);
-            buf_remove_header(buf, ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t));
-            len_sum += ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t);
+            buf_init(&ip_buf, frag_len);
+            memcpy(ip_buf.data, buf->data, frag_len);
+            ip_fragment_out(&ip_buf, ip, protocol, ip_id, len_sum / IP_HDR_OFFSET_PER_BYTE, 1, 0, next_hop, netif);
+            buf_remove_header(buf, frag_len);
+            len_sum += frag_len;
         }
 
         // 发送最后一个切片
@@ -133,17 +413,180 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
         {
             buf_init(&ip_buf, buf->len);
             memcpy(ip_buf.data, buf->data, buf->len);
-            ip_fragment_out(&ip_buf, ip, protocol, ip_id, len_sum / IP_HDR_OFFSET_PER_BYTE, 0);
+            ip_fragment_out(&ip_buf, ip, protocol, ip_id, len_sum / IP_HDR_OFFSET_PER_BYTE, 0, 0, next_hop, netif);
             ip_id += 1;
         }
     }
+    return 0;
+}
+
+/**
+ * @brief 处理一个要发送的ip数据包，超过路径mtu时分片
+ *
+ * @param buf 要处理的包
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ */
+void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+{
+    ip_output(buf, ip, protocol, 0);
+}
+
+/**
+ * @brief 发送一个置DF位的ip数据包，超过路径mtu时丢弃而不分片
+ *
+ * @param buf 要处理的包
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ * @return int 成功为0，无路由或超过路径mtu为-1
+ */
+int ip_out_df(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+{
+    return ip_output(buf, ip, protocol, 1);
+}
+
+/**
+ * @brief 选择发往目的地址的数据包的源地址，即路由出口网卡上的地址
+ *
+ * @param dst_ip 目的ip地址
+ * @return uint8_t* 源ip地址，无路由为NULL
+ */
+uint8_t *ip_src_addr(uint8_t *dst_ip)
+{
+    route_t *route = route_lookup(dst_ip);
+    return route ? net_if_src_ip(route->netif, dst_ip) : NULL;
+}
+
+/**
+ * @brief 分配一个数据包标识，供自行填写ip首部的发送路径使用
+ *
+ * @return uint16_t 数据包标识
+ */
+uint16_t ip_next_id()
+{
+    return ip_id++;
+}
+
+/**
+ * @brief 解析发往目的地址的路径，供批量发送复用
+ *        下一跳按五元组选择，与ip_out对同一流的选择一致
+ *
+ * @param path 返回的路径
+ * @param dst_ip 目的ip地址
+ * @param protocol 上层协议
+ * @param src_port 源端口，用于选择等价网关，无端口的协议为0
+ * @param dst_port 目的端口，用于选择等价网关，无端口的协议为0
+ * @param df 是否置DF位
+ * @return int 成功为0，无路由为-1，下一跳mac未解析为1，此时应经ip_out发送以触发arp请求，
+ *             下一跳已有数据包在arp缓存中等待解析为2，此时再发送的数据包会被arp_out丢弃
+ */
+int ip_path_resolve(ip_tx_path_t *path, uint8_t *dst_ip, net_protocol_t protocol, uint16_t src_port, uint16_t dst_port, int df)
+{
+    route_t *route = route_lookup(dst_ip);
+    if (route == NULL)
+        return -1;
+    path->netif = route->netif;
+    path->mtu = ip_route_mtu(route, dst_ip);
+    uint8_t *src_ip = net_if_src_ip(path->netif, dst_ip);
+    uint8_t *next_hop = route_next_hop(route, dst_ip, flow_hash(src_ip, dst_ip, protocol, src_port, dst_port));
+    // 先取版本再查找，查找后的更新会使路径失效
+    path->generation = __atomic_load_n(&arp_generation, __ATOMIC_ACQUIRE) + route_generation + ip_pmtu_generation;
+    if (arp_lookup(next_hop, path->mac) < 0)
+        return arp_pending(next_hop) ? 2 : 1;
+    path->resolved = time(NULL);
+
+    ip_hdr_t *hdr = &path->hdr;
+    memset(hdr, 0, sizeof(ip_hdr_t));
+    hdr->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+    hdr->version = IP_VERSION_4;
+    hdr->flags_fragment16 = swap16(df ? IP_DONT_FRAGMENT : 0);
+    hdr->ttl = IP_DEFALUT_TTL;
+    hdr->protocol = protocol;
+    memcpy(hdr->src_ip, src_ip, NET_IP_LEN);
+    memcpy(hdr->dst_ip, dst_ip, NET_IP_LEN);
+    return 0;
+}
+
+/**
+ * @brief 判断已解析的路径是否仍然有效
+ *        路由、arp映射或路径mtu改变后失效，超过arp表项的过期时间也失效，以便重新确认邻居
+ *
+ * @param path ip_path_resolve解析成功的路径
+ * @return int 有效为1，否则为0
+ */
+int ip_path_valid(ip_tx_path_t *path)
+{
+    ip_pmtu_expire();
+    return path->generation == __atomic_load_n(&arp_generation, __ATOMIC_ACQUIRE) + route_generation + ip_pmtu_generation &&
+           path->resolved + ARP_TIMEOUT_SEC >= time(NULL);
+}
+
+/**
+ * @brief 按已解析的路径发送一个不超过路径mtu的数据包
+ *
+ * @param path ip_path_resolve解析的路径
+ * @param buf 要发送的上层数据包
+ */
+void ip_path_out(ip_tx_path_t *path, buf_t *buf)
+{
+    buf_add_header(buf, sizeof(ip_hdr_t));
+    ip_hdr_t *hdr = (ip_hdr_t *)buf->data;
+    memcpy(hdr, &path->hdr, sizeof(ip_hdr_t));
+    hdr->total_len16 = swap16(buf->len);
+    hdr->id16 = swap16(ip_next_id());
+    hdr->hdr_checksum16 = swap16(checksum16((uint16_t *)hdr, sizeof(ip_hdr_t)));
+    ethernet_out(buf, path->mac, NET_PROTOCOL_IP, path->netif);
+}
+
+/**
+ * @brief 按网卡表与默认网关建立各协议栈实例共用的路由表，进程内只建立一次
+ *        没有其他实例运行时才能调用，多线程运行时由net_shared_init在启动线程前调用
+ *
+ */
+void ip_route_init()
+{
+    if (ip_route_built)
+        return;
+    ip_route_built = 1;
+    route_init();
+    // 每块网卡每个地址所在网段的直连路由
+    static const uint8_t all_ones[NET_IP_LEN] = {255, 255, 255, 255};
+    uint8_t prefix[NET_IP_LEN];
+    for (size_t i = 0; i < net_if_num; i++)
+    {
+        net_if_t *netif = &net_if_table[i];
+        for (size_t j = 0; j < NET_IF_MAX_IP; j++)
+        {
+            if (!net_if_has_ip(netif, netif->ip[j]))
+                continue;
+            for (int k = 0; k < NET_IP_LEN; k++)
+                prefix[k] = netif->ip[j][k] & netif->netmask[k];
+            route_add(prefix, ip_prefix_match(netif->netmask, (uint8_t *)all_ones), NULL, netif);
+        }
+    }
+    // 默认路由，出口为第一个网关所在网段的网卡
+    static const uint8_t any[NET_IP_LEN] = {0};
+    uint8_t gateways[ROUTE_MAX_ECMP][NET_IP_LEN];
+    size_t gateway_num = 0;
+    for (size_t i = 0; i < net_if_gateway_num && gateway_num < ROUTE_MAX_ECMP; i++)
+        if (net_if_gateways[i][0] || net_if_gateways[i][1] || net_if_gateways[i][2] || net_if_gateways[i][3])
+            memcpy(gateways[gateway_num++], net_if_gateways[i], NET_IP_LEN);
+    route_t *connected = gateway_num ? route_lookup(gateways[0]) : NULL;
+    if (connected)
+        route_add_multipath(any, 0, (const uint8_t(*)[NET_IP_LEN])gateways, gateway_num, connected->netif);
 }
 
 /**
  * @brief 初始化ip协议
+ *        路由表为各协议栈实例共用，尚未建立时在此建立，之后各实例只读取
  *
  */
 void ip_init()
 {
+    memset(ip_pmtu_cache, 0, sizeof(ip_pmtu_cache));
+    ip_pmtu_num = 0;
+    ip_pmtu_next_expire = 0;
+    ip_pmtu_serial = 0;
+    ip_route_init();
     net_add_protocol(NET_PROTOCOL_IP, ip_in);
 }
\ No newline at end of file
@@ -1,6 +1,10 @@
 #include "net.h"
 #include "udp.h"
 #include "driver.h"
+#include "ip.h"
+#include "icmp.h"
+#include "worker.h"
+#include "pipeline.h"
 
 #ifdef UDP
 void handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
@@ -11,10 +15,51 @@ void handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
     putchar('\n');
     udp_send(data, len, 60000, src_ip, 60000); //发送udp包
 }
+
+/**
+ * @brief 工作线程在自己的协议栈实例中打开端口
+ * 
+ * @param index 工作线程号
+ */
+void worker_setup(int index)
+{
+    udp_open(60000, handler);
+}
 #endif
 
 int main(int argc, char const *argv[])
 {
+    int forward = argc > 1 && !strcmp(argv[1], "forward"); //以软件路由器模式运行
+    uint8_t ping_ip[NET_IP_LEN];
+    int ping = argc > 2 && !strcmp(argv[1], "ping") && //测量到对端的往返时间后退出
+               sscanf(argv[2], "%hhu.%hhu.%hhu.%hhu", &ping_ip[0], &ping_ip[1], &ping_ip[2], &ping_ip[3]) == NET_IP_LEN;
+#if defined(NET_STACK_PER_THREAD) && defined(UDP)
+    if (argc > 2 && !strcmp(argv[1], "workers")) //按核分片运行多个工作线程，回车后退出
+    {
+        if (worker_start(atoi(argv[2]), worker_setup) == -1)
+        {
+            printf("worker start failed.\n");
+            return -1;
+        }
+        getchar();
+        worker_stop();
+        return 0;
+    }
+    if (argc > 2 && !strcmp(argv[1], "pipeline")) //收、协议处理与发分别在不同线程运行，回车后退出
+    {
+        if (pipeline_start(atoi(argv[2]), worker_setup) == -1)
+        {
+            printf("pipeline start failed.\n");
+            return -1;
+        }
+        getchar();
+        pipeline_stop();
+        printf("rx %llu dropped %llu tx %llu dropped %llu\n", (unsigned long long)pipeline_stats.rx_frames,
+               (unsigned long long)pipeline_stats.rx_dropped, (unsigned long long)pipeline_stats.tx_frames,
+               (unsigned long long)pipeline_stats.tx_dropped);
+        return 0;
+    }
+#endif
 
     if (net_init() == -1) //初始化协议栈
     {
@@ -24,9 +69,36 @@ int main(int argc, char const *argv[])
 #ifdef UDP
     udp_open(60000, handler); //注册端口的udp监听回调
 #endif
+    if (forward)
+        ip_forward_enable(1);
+#ifdef ICMP
+    if (ping)
+    {
+        if (icmp_ping(ping_ip, argc > 3 ? atoi(argv[3]) : 10, 1000, 56) == -1)
+        {
+            printf("ping %s failed.\n", argv[2]);
+            return -1;
+        }
+        while (icmp_ping_session.active)
+            net_poll();
+        icmp_ping_print();
+        return 0;
+    }
+#endif
+    time_t last = time(NULL);
+    uint64_t last_forwarded = 0;
     while (1)
     {
         net_poll(); //一次主循环
+        if (forward && time(NULL) != last) //每秒打印一次转发速率
+        {
+            time_t now = time(NULL);
+            printf("forward %.0f pps, ttl exceeded %llu, no route %llu\n",
+                   (double)(ip_forward_stats.forwarded - last_forwarded) / (now - last),
+                   (unsigned long long)ip_forward_stats.ttl_exceeded, (unsigned long long)ip_forward_stats.no_route);
+            last = now;
+            last_forwarded = ip_forward_stats.forwarded;
+        }
     }
 
     return 0;
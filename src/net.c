@@ -5,46 +5,75 @@
 #include "ip.h"
 #include "icmp.h"
 #include "udp.h"
+#include "udplite.h"
 
 /**
  * @brief 协议表 <协议号,处理程序>的容器
  * 
  */
-map_t net_table;
+NET_TLS map_t net_table;
 
 /**
- * @brief 网卡MAC地址
+ * @brief 网卡表
  * 
  */
-uint8_t net_if_mac[NET_MAC_LEN] = NET_IF_MAC;
+net_if_t net_if_table[] = NET_IF_CONFIG;
+const size_t net_if_num = sizeof(net_if_table) / sizeof(net_if_t);
 
 /**
- * @brief 网卡IP地址
+ * @brief 网卡在当前协议栈实例中的状态，与网卡表按下标对应
  * 
  */
-uint8_t net_if_ip[NET_IP_LEN] = NET_IF_IP;
+NET_TLS net_if_state_t net_if_states[NET_IF_MAX_NUM];
+
+/**
+ * @brief 默认路由的等价网关
+ * 
+ */
+uint8_t net_if_gateways[][NET_IP_LEN] = NET_IF_GATEWAYS;
+const size_t net_if_gateway_num = sizeof(net_if_gateways) / NET_IP_LEN;
 
 /**
  * @brief 网卡接收和发送缓冲区
  * 
  */
-buf_t rxbuf, txbuf; //一个buf足够单线程使用
+NET_TLS buf_t rxbuf, txbuf; //每个协议栈实例一对
+
+/**
+ * @brief 初始化各协议栈实例共用的arp表与路由表，进程内只初始化一次
+ *        多线程运行时须在启动任何实例之前调用，worker_start与pipeline_start会先调用，之后各实例的net_init不再写共用的表；
+ *        单线程运行时由net_init完成，无需调用
+ * 
+ */
+void net_shared_init()
+{
+    arp_table_init();
+    ip_route_init();
+}
 
 /**
  * @brief 初始化协议栈
+ *        定义NET_STACK_PER_THREAD时初始化的是调用线程的协议栈实例，每个线程可各自初始化并轮询，
+ *        网卡表、路由表与arp表为各实例共用，见net_shared_init，各实例的协议表、arp缓存、端口、缓冲区与网卡句柄互相独立
  * 
  */
 int net_init()
 {
-    map_init(&net_table, sizeof(uint16_t), sizeof(net_handler_t), 0, 0, NULL);
-    if (driver_open() == -1)
+    if (net_if_num > NET_IF_MAX_NUM)
         return -1;
+    map_init(&net_table, sizeof(uint16_t), sizeof(net_handler_t), 0, 0, NULL);
+    for (size_t i = 0; i < net_if_num; i++)
+        if (driver_open(&net_if_table[i]) == -1)
+            return -1;
 
     ethernet_init();
     arp_init();
     ip_init();
     icmp_init();
     udp_init();
+#ifdef UDPLITE
+    udplite_init();
+#endif
     return 0;
 }
 
@@ -65,26 +94,99 @@ void net_add_protocol(uint16_t protocol, net_handler_t handler)
  * @param buf 要传递的数据包
  * @param protocol 上层协议号
  * @param src 源的本层协议地址，如mac或ip地址
+ * @param netif 收到数据包的网卡
  * @return int 成功为0，失败为-1
  */
-int net_in(buf_t *buf, uint16_t protocol, uint8_t *src)
+int net_in(buf_t *buf, uint16_t protocol, uint8_t *src, net_if_t *netif)
 {
     net_handler_t *handler = map_get(&net_table, &protocol);
     if (handler)
     {
-        (*handler)(buf, src);
+        (*handler)(buf, src, netif);
         return 0;
     }
     return -1;
 }
 
 /**
- * @brief 一次协议栈轮询
+ * @brief 判断ip地址是否属于网卡
+ * 
+ * @param netif 网卡
+ * @param ip ip地址
+ * @return int 属于为1，否则为0
+ */
+int net_if_has_ip(net_if_t *netif, const uint8_t *ip)
+{
+    static const uint8_t zero_ip[NET_IP_LEN] = {0};
+    if (!memcmp(ip, zero_ip, NET_IP_LEN))
+        return 0;
+    for (size_t i = 0; i < NET_IF_MAX_IP; i++)
+        if (!memcmp(netif->ip[i], ip, NET_IP_LEN))
+            return 1;
+    return 0;
+}
+
+/**
+ * @brief 查找拥有某个ip地址的网卡
+ * 
+ * @param ip ip地址
+ * @return net_if_t* 拥有该地址的网卡，不是本机地址为NULL
+ */
+net_if_t *net_if_find(const uint8_t *ip)
+{
+    for (size_t i = 0; i < net_if_num; i++)
+        if (net_if_has_ip(&net_if_table[i], ip))
+            return &net_if_table[i];
+    return NULL;
+}
+
+/**
+ * @brief 为发往目的地址的数据包选择网卡上的源地址，优先选择与目的地址同网段的地址
  * 
+ * @param netif 出口网卡
+ * @param dst_ip 目的ip地址
+ * @return uint8_t* 源ip地址，没有同网段地址时为主地址
  */
-void net_poll()
+uint8_t *net_if_src_ip(net_if_t *netif, const uint8_t *dst_ip)
 {
+    static const uint8_t zero_ip[NET_IP_LEN] = {0};
+    for (size_t i = 0; i < NET_IF_MAX_IP; i++)
+    {
+        if (!memcmp(netif->ip[i], zero_ip, NET_IP_LEN))
+            continue;
+        int match = 1;
+        for (int j = 0; j < NET_IP_LEN && match; j++)
+            match = (netif->ip[i][j] & netif->netmask[j]) == (dst_ip[j] & netif->netmask[j]);
+        if (match)
+            return netif->ip[i];
+    }
+    return netif->ip[0];
+}
+
+/**
+ * @brief 一次协议栈轮询，每块网卡最多处理NET_POLL_BURST个数据包，期间产生的发送统一批量发出
+ * 
+ * @return int 本次处理的数据包数
+ */
+int net_poll()
+{
+    int num = 0;
 #ifdef ETHERNET
-    ethernet_poll();
+    driver_tx_begin();
+    for (size_t i = 0; i < net_if_num; i++)
+        for (int n = 0; n < NET_POLL_BURST && ethernet_poll(&net_if_table[i]); n++)
+            num++;
+#ifdef ARP
+    arp_poll();
+#endif
+#ifdef ICMP
+    icmp_ping_poll();
+#endif
+#ifdef UDP
+    udp_gro_flush();
+    udp_flush_corked();
+#endif
+    driver_tx_flush();
 #endif
+    return num;
 }
\ No newline at end of file
@@ -0,0 +1,327 @@
+#include <sched.h>
+#include <pthread.h>
+#include "pipeline.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "icmp.h"
+#include "udp.h"
+
+#ifdef NET_STACK_PER_THREAD
+
+/**
+ * @brief 流水线统计，收线程与发线程各自写入自己的字段，tx_dropped由协议处理线程经driver_send原子地累加
+ *
+ */
+pipeline_stats_t pipeline_stats;
+
+typedef enum pipeline_state
+{
+    PIPELINE_STARTING, // 正在初始化
+    PIPELINE_RUNNING,  // 正在运行
+    PIPELINE_FAILED,   // 初始化失败，线程已退出
+} pipeline_state_t;
+
+/**
+ * @brief 协议处理线程，每个线程运行一个挂接到环上的协议栈实例
+ *        收线程按流哈希选择协议处理线程，同一流总进入同一线程
+ *
+ */
+static struct
+{
+    pthread_t thread;
+    int index;
+    int state;
+    ring_t rx_rings[NET_IF_MAX_NUM]; // 收线程到本线程，每块网卡一个
+    ring_t tx_ring;                  // 本线程到发线程
+} pipeline_protos[PIPELINE_MAX_PROTO];
+static int pipeline_proto_num;
+static worker_setup_t pipeline_setup;
+
+static pthread_t pipeline_rx_thread, pipeline_tx_thread;
+static int pipeline_rx_state, pipeline_tx_state;
+static int pipeline_rx_running, pipeline_proto_running, pipeline_tx_running;
+
+/**
+ * @brief 收线程打开的网卡句柄，发线程共用其发送
+ *
+ */
+static void *pipeline_handles[NET_IF_MAX_NUM];
+
+/**
+ * @brief 内部函数，等待线程初始化完成
+ *
+ * @param state 线程状态
+ * @return int 运行中为0，初始化失败为-1
+ */
+static int pipeline_wait(int *state)
+{
+    int now;
+    while ((now = __atomic_load_n(state, __ATOMIC_ACQUIRE)) == PIPELINE_STARTING)
+        sched_yield();
+    return now == PIPELINE_RUNNING ? 0 : -1;
+}
+
+/**
+ * @brief 内部函数，按帧的流选择协议处理线程，与worker的分片规则一致，非ip帧进入线程0
+ *        目的不可达报文按其引用的原数据报选择，原数据报由本机发出，源与目的交换后即为对端发来的流，
+ *        因此进入处理该流的线程，其路径mtu与差错能被该线程处理
+ *
+ * @param data 以太网帧
+ * @param len 帧长
+ * @return int 协议处理线程号
+ */
+static int pipeline_select(const uint8_t *data, size_t len)
+{
+    const ether_hdr_t *eth = (const ether_hdr_t *)data;
+    if (pipeline_proto_num == 1 || len < sizeof(ether_hdr_t) + sizeof(ip_hdr_t) || eth->protocol16 != swap16(NET_PROTOCOL_IP))
+        return 0;
+    const ip_hdr_t *ip = (const ip_hdr_t *)(eth + 1);
+    const uint8_t *end = data + len;
+    size_t hdr_len = ip->hdr_len * IP_HDR_LEN_PER_BYTE;
+    int reverse = 0;
+    const icmp_hdr_t *icmp = (const icmp_hdr_t *)((const uint8_t *)ip + hdr_len);
+    const ip_hdr_t *orig = (const ip_hdr_t *)(icmp + 1);
+    if (ip->protocol == NET_PROTOCOL_ICMP && !(swap16(ip->flags_fragment16) & (IP_MORE_FRAGMENT | IP_FRAGMENT_OFFSET_MASK)) &&
+        (const uint8_t *)(orig + 1) <= end && icmp->type == ICMP_TYPE_UNREACH)
+    {
+        ip = orig;
+        hdr_len = ip->hdr_len * IP_HDR_LEN_PER_BYTE;
+        reverse = 1;
+    }
+    uint16_t src_port = 0, dst_port = 0;
+    // 未分片的udp数据报按端口区分流，分片只按地址，使同一数据报的分片进入同一线程
+    if (ip->protocol == NET_PROTOCOL_UDP && !(swap16(ip->flags_fragment16) & (IP_MORE_FRAGMENT | IP_FRAGMENT_OFFSET_MASK)) &&
+        (const uint8_t *)ip + hdr_len + sizeof(udp_hdr_t) <= end)
+    {
+        const udp_hdr_t *udp = (const udp_hdr_t *)((const uint8_t *)ip + hdr_len);
+        src_port = swap16(udp->src_port16);
+        dst_port = swap16(udp->dst_port16);
+    }
+    if (reverse)
+        return flow_hash(ip->dst_ip, ip->src_ip, ip->protocol, dst_port, src_port) % pipeline_proto_num;
+    return flow_hash(ip->src_ip, ip->dst_ip, ip->protocol, src_port, dst_port) % pipeline_proto_num;
+}
+
+/**
+ * @brief 内部函数，收线程：打开网卡，把收到的帧放入所选协议处理线程的接收环，只进行接收的系统调用
+ *
+ * @param arg 未使用
+ * @return void* NULL
+ */
+static void *pipeline_rx_main(void *arg)
+{
+    worker_pin(0);
+    for (size_t i = 0; i < net_if_num; i++)
+    {
+        if (driver_open(&net_if_table[i]) == -1)
+        {
+            while (i--)
+                driver_close(&net_if_table[i]);
+            __atomic_store_n(&pipeline_rx_state, PIPELINE_FAILED, __ATOMIC_RELEASE);
+            return NULL;
+        }
+        pipeline_handles[i] = NET_IF_STATE(&net_if_table[i])->driver;
+    }
+    __atomic_store_n(&pipeline_rx_state, PIPELINE_RUNNING, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&pipeline_rx_running, __ATOMIC_ACQUIRE))
+    {
+        for (size_t i = 0; i < net_if_num; i++)
+        {
+            const uint8_t *data;
+            int len;
+            for (int n = 0; n < NET_POLL_BURST && (len = driver_recv_peek(&net_if_table[i], &data)) > 0; n++)
+            {
+                ring_t *ring = &pipeline_protos[pipeline_select(data, len)].rx_rings[i];
+                driver_frame_t *frame = len <= DRIVER_TX_FRAME_MAX ? ring_enqueue_slot(ring) : NULL;
+                if (frame == NULL)
+                {
+                    pipeline_stats.rx_dropped++;
+                    continue;
+                }
+                frame->netif = &net_if_table[i];
+                frame->len = len;
+                memcpy(frame->data, data, len);
+                ring_enqueue_commit(ring);
+                pipeline_stats.rx_frames++;
+            }
+        }
+    }
+    // 发线程退出后才能关闭共用的句柄
+    while (__atomic_load_n(&pipeline_tx_running, __ATOMIC_ACQUIRE))
+        sched_yield();
+    for (size_t i = 0; i < net_if_num; i++)
+        driver_close(&net_if_table[i]);
+    return NULL;
+}
+
+/**
+ * @brief 内部函数，协议处理线程：在挂接到环上的协议栈实例中轮询，不进行系统调用
+ *
+ * @param arg 线程号
+ * @return void* NULL
+ */
+static void *pipeline_proto_main(void *arg)
+{
+    int index = *(int *)arg;
+    worker_pin(index + 1);
+    driver_attach(pipeline_protos[index].rx_rings, &pipeline_protos[index].tx_ring, &pipeline_stats.tx_dropped);
+    if (net_init() == -1)
+    {
+        __atomic_store_n(&pipeline_protos[index].state, PIPELINE_FAILED, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    if (pipeline_setup)
+        pipeline_setup(index);
+    __atomic_store_n(&pipeline_protos[index].state, PIPELINE_RUNNING, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&pipeline_proto_running, __ATOMIC_ACQUIRE))
+        net_poll();
+    return NULL;
+}
+
+/**
+ * @brief 内部函数，发线程：轮流取出各协议处理线程发送环中的帧，成批发出
+ *
+ * @param arg 未使用
+ * @return void* NULL
+ */
+static void *pipeline_tx_main(void *arg)
+{
+    worker_pin(pipeline_proto_num + 1);
+    for (size_t i = 0; i < net_if_num; i++)
+        NET_IF_STATE(&net_if_table[i])->driver = pipeline_handles[i];
+    __atomic_store_n(&pipeline_tx_state, PIPELINE_RUNNING, __ATOMIC_RELEASE);
+    for (;;)
+    {
+        // 停止时先发完环中剩余的帧
+        int running = __atomic_load_n(&pipeline_tx_running, __ATOMIC_ACQUIRE);
+        int sent = 0;
+        driver_tx_begin();
+        for (int i = 0; i < pipeline_proto_num; i++)
+        {
+            ring_t *ring = &pipeline_protos[i].tx_ring;
+            driver_frame_t *frame;
+            for (int n = 0; n < DRIVER_TX_BURST && (frame = ring_dequeue_slot(ring)); n++, sent++)
+            {
+                // 直接从环的槽位发出，不再复制到txbuf
+                driver_send_frame(frame->netif, frame->data, frame->len);
+                ring_dequeue_commit(ring);
+            }
+        }
+        driver_tx_flush();
+        pipeline_stats.tx_frames += sent;
+        if (!running && sent == 0)
+            break;
+    }
+    for (size_t i = 0; i < net_if_num; i++)
+        NET_IF_STATE(&net_if_table[i])->driver = NULL;
+    return NULL;
+}
+
+/**
+ * @brief 启动流水线运行时
+ *        一个收线程调用driver_recv，若干协议处理线程完成ethernet_in到udp_in的处理，一个发线程调用driver_send，
+ *        线程间以单生产者单消费者的无锁环传递帧，系统调用移出协议处理线程，对时延敏感的处理程序时延更稳定
+ *        收线程绑定到核0，协议处理线程依次绑定到核1起，发线程绑定到其后的核
+ *
+ * @param proto_num 协议处理线程数，不超过PIPELINE_MAX_PROTO
+ * @param setup 每个协议处理线程初始化协议栈后调用的程序，可为NULL
+ * @return int 成功为0，失败为-1，此时已启动的线程被停止
+ */
+int pipeline_start(int proto_num, worker_setup_t setup)
+{
+    if (proto_num < 1 || proto_num > PIPELINE_MAX_PROTO || pipeline_proto_num)
+        return -1;
+    for (int i = 0; i < proto_num; i++)
+    {
+        int failed = ring_init(&pipeline_protos[i].tx_ring, sizeof(driver_frame_t), PIPELINE_RING_DEPTH) < 0;
+        for (size_t j = 0; j < net_if_num && !failed; j++)
+            failed = ring_init(&pipeline_protos[i].rx_rings[j], sizeof(driver_frame_t), PIPELINE_RING_DEPTH) < 0;
+        if (failed)
+        {
+            pipeline_stop();
+            return -1;
+        }
+    }
+    net_shared_init();
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    // 协议栈实例位于线程局部存储，默认的栈容纳不下
+    pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+    pipeline_proto_num = proto_num;
+    pipeline_setup = setup;
+    pipeline_rx_running = pipeline_proto_running = pipeline_tx_running = 1;
+    pipeline_rx_state = pipeline_tx_state = PIPELINE_STARTING;
+
+    int ret = -1, started = 0;
+    if (pthread_create(&pipeline_rx_thread, &attr, pipeline_rx_main, NULL) == 0)
+    {
+        if (pipeline_wait(&pipeline_rx_state) == 0)
+        {
+            // 协议处理线程逐个启动，某个线程失败时不再启动后续线程
+            for (; started < proto_num; started++)
+            {
+                pipeline_protos[started].index = started;
+                pipeline_protos[started].state = PIPELINE_STARTING;
+                if (pthread_create(&pipeline_protos[started].thread, &attr, pipeline_proto_main, &pipeline_protos[started].index))
+                    break;
+                if (pipeline_wait(&pipeline_protos[started].state) < 0)
+                {
+                    pthread_join(pipeline_protos[started].thread, NULL);
+                    break;
+                }
+            }
+            if (started == proto_num && pthread_create(&pipeline_tx_thread, &attr, pipeline_tx_main, NULL) == 0)
+                ret = pipeline_wait(&pipeline_tx_state);
+            else
+                __atomic_store_n(&pipeline_tx_running, 0, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            pthread_join(pipeline_rx_thread, NULL);
+            pipeline_rx_state = PIPELINE_FAILED;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    if (ret < 0)
+    {
+        fprintf(stderr, "Error in pipeline_start.\n");
+        pipeline_proto_num = started;
+        pipeline_stop();
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 停止流水线，依次停止协议处理线程、发线程与收线程，发线程发完已处理的帧后退出
+ *
+ */
+void pipeline_stop()
+{
+    __atomic_store_n(&pipeline_proto_running, 0, __ATOMIC_RELEASE);
+    for (int i = 0; i < pipeline_proto_num; i++)
+        pthread_join(pipeline_protos[i].thread, NULL);
+    if (pipeline_tx_state == PIPELINE_RUNNING)
+    {
+        __atomic_store_n(&pipeline_tx_running, 0, __ATOMIC_RELEASE);
+        pthread_join(pipeline_tx_thread, NULL);
+    }
+    if (pipeline_rx_state == PIPELINE_RUNNING)
+    {
+        __atomic_store_n(&pipeline_rx_running, 0, __ATOMIC_RELEASE);
+        pthread_join(pipeline_rx_thread, NULL);
+    }
+    for (int i = 0; i < PIPELINE_MAX_PROTO; i++)
+    {
+        for (size_t j = 0; j < net_if_num; j++)
+            if (pipeline_protos[i].rx_rings[j].slots)
+                ring_free(&pipeline_protos[i].rx_rings[j]);
+        if (pipeline_protos[i].tx_ring.slots)
+            ring_free(&pipeline_protos[i].tx_ring);
+    }
+    pipeline_proto_num = 0;
+    pipeline_rx_state = pipeline_tx_state = PIPELINE_STARTING;
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+
+/**
+ * @brief 初始化环形队列
+ *
+ * @param ring 要初始化的队列
+ * @param elem_size 元素大小
+ * @param depth 队列深度，向上取整到2的幂
+ * @return int 成功为0，内存不足为-1
+ */
+int ring_init(ring_t *ring, size_t elem_size, uint32_t depth)
+{
+    uint32_t size = 1;
+    while (size < depth)
+        size <<= 1;
+    memset(ring, 0, sizeof(ring_t));
+    ring->slots = malloc(elem_size * size);
+    if (ring->slots == NULL)
+        return -1;
+    ring->elem_size = elem_size;
+    ring->mask = size - 1;
+    return 0;
+}
+
+/**
+ * @brief 释放环形队列的存储区，调用时生产者与消费者都不能再访问队列
+ *
+ * @param ring 要释放的队列
+ */
+void ring_free(ring_t *ring)
+{
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+/**
+ * @brief 获取队列深度
+ *
+ * @param ring 队列
+ * @return uint32_t 最多可容纳的元素数
+ */
+uint32_t ring_depth(ring_t *ring)
+{
+    return ring->mask + 1;
+}
+
+/**
+ * @brief 获取队列中的元素数，并发访问时仅为近似值
+ *
+ * @param ring 队列
+ * @return uint32_t 元素数
+ */
+uint32_t ring_count(ring_t *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief 生产者获取下一个可写入的位置，写完后调用ring_enqueue_commit发布
+ *
+ * @param ring 队列
+ * @return void* 可写入的元素指针，队列满为NULL
+ */
+void *ring_enqueue_slot(ring_t *ring)
+{
+    uint32_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask)
+        return NULL;
+    return ring->slots + (head & ring->mask) * ring->elem_size;
+}
+
+/**
+ * @brief 生产者发布ring_enqueue_slot取得的元素，消费者此后可见
+ *
+ * @param ring 队列
+ */
+void ring_enqueue_commit(ring_t *ring)
+{
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 生产者丢弃最旧的元素以腾出空间，用于满时覆盖旧数据的策略
+ *
+ * @param ring 队列
+ * @return int 丢弃了一个元素为0，队列已不满（消费者恰好取走了元素）为-1
+ */
+int ring_drop_oldest(ring_t *ring)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (ring->head - tail <= ring->mask)
+        return -1;
+    // 与消费者竞争同一个下标，失败说明消费者已取走该元素
+    return __atomic_compare_exchange_n(&ring->tail, &tail, tail + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ? 0 : -1;
+}
+
+/**
+ * @brief 消费者获取最旧的元素，读完后调用ring_dequeue_commit出队
+ *
+ * @param ring 队列
+ * @return void* 元素指针，队列空为NULL
+ */
+void *ring_dequeue_slot(ring_t *ring)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+        return NULL;
+    ring->reading = tail;
+    return ring->slots + (tail & ring->mask) * ring->elem_size;
+}
+
+/**
+ * @brief 消费者出队ring_dequeue_slot取得的元素
+ * 生产者可能在消费者读取期间丢弃并覆盖了该元素，此时读到的内容无效，应重新获取
+ *
+ * @param ring 队列
+ * @return int 读到的元素有效为0，已被生产者丢弃为-1
+ */
+int ring_dequeue_commit(ring_t *ring)
+{
+    uint32_t expected = ring->reading;
+    // 读取期间tail未被生产者推进，说明元素在读取完成前未被覆盖
+    return __atomic_compare_exchange_n(&ring->tail, &expected, ring->reading + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ? 0 : -1;
+}
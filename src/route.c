@@ -0,0 +1,489 @@
+#include "route.h"
+
+/**
+ * @brief DIR-24-8路由表第一级，按目的地址高24位索引
+ *
+ */
+static uint32_t route_tbl24[ROUTE_TBL24_NUM];
+
+/**
+ * @brief DIR-24-8路由表第二级，长度大于24的前缀展开到tbl8组中
+ *
+ */
+static uint32_t route_tbl8[ROUTE_TBL8_GROUP_NUM * ROUTE_TBL8_GROUP_SIZE];
+
+/**
+ * @brief tbl8空闲组栈
+ *
+ */
+static uint32_t route_tbl8_free[ROUTE_TBL8_GROUP_NUM];
+static size_t route_tbl8_free_num;
+
+/**
+ * @brief 路由规则表，转发表表项中保存的是规则的下标
+ *
+ */
+static route_t route_rules[ROUTE_MAX_NUM];
+static size_t route_rules_num;     //已使用过的最大下标
+static uint32_t route_rules_free[ROUTE_MAX_NUM];
+static size_t route_rules_free_num;
+static size_t route_num;           //有效路由数
+
+/**
+ * @brief 路由表版本，每次修改加1，缓存了查找结果的调用者据此判断是否失效
+ *
+ */
+uint32_t route_generation;
+
+/**
+ * @brief <前缀,长度>到规则下标的线性探测哈希索引，值为下标+1，0为空
+ *        删除时后移回填，不留墓碑，反复增删后探测长度也不会增长
+ *
+ */
+#define ROUTE_HASH_NUM (2 * ROUTE_MAX_NUM)
+static uint32_t route_hash[ROUTE_HASH_NUM];
+
+/**
+ * @brief 默认路由的下标，-1为不存在。默认路由不展开到表中
+ *
+ */
+static int64_t route_default = -1;
+
+/**
+ * @brief 内部函数，ip转主机序整数
+ *
+ * @param ip ip地址
+ * @return uint32_t 主机序整数
+ */
+static inline uint32_t route_ip_to_u32(const uint8_t *ip)
+{
+    return ((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) | ((uint32_t)ip[2] << 8) | ip[3];
+}
+
+/**
+ * @brief 内部函数，生成指向路由规则的表项
+ *
+ * @param depth 前缀长度
+ * @param index 规则下标
+ * @return uint32_t 表项
+ */
+static inline uint32_t route_entry(uint8_t depth, uint32_t index)
+{
+    return ROUTE_ENTRY_VALID | ((uint32_t)depth << ROUTE_ENTRY_DEPTH_SHIFT) | index;
+}
+
+static inline uint8_t route_entry_depth(uint32_t entry)
+{
+    return (entry >> ROUTE_ENTRY_DEPTH_SHIFT) & ROUTE_ENTRY_DEPTH_MASK;
+}
+
+/**
+ * @brief 内部函数，获取某个地址最终命中的表项
+ *
+ * @param addr 主机序地址
+ * @return uint32_t 表项，未命中为0
+ */
+static inline uint32_t route_entry_get(uint32_t addr)
+{
+    uint32_t entry = route_tbl24[addr >> 8];
+    if (entry & ROUTE_ENTRY_EXT)
+        entry = route_tbl8[(entry & ROUTE_ENTRY_INDEX_MASK) * ROUTE_TBL8_GROUP_SIZE + (addr & 0xFF)];
+    return entry;
+}
+
+/**
+ * @brief 内部函数，用新表项覆盖不比它更长的表项
+ *
+ * @param tbl 表项数组
+ * @param num 表项数
+ * @param depth 新表项的前缀长度
+ * @param entry 新表项
+ */
+static void route_fill(uint32_t *tbl, size_t num, uint8_t depth, uint32_t entry)
+{
+    for (size_t i = 0; i < num; i++)
+        if (!(tbl[i] & ROUTE_ENTRY_VALID) || route_entry_depth(tbl[i]) <= depth)
+            tbl[i] = entry;
+}
+
+/**
+ * @brief 内部函数，把前缀长度为depth的表项替换为另一表项，用于删除路由
+ *
+ * @param tbl 表项数组
+ * @param num 表项数
+ * @param depth 被删除路由的前缀长度
+ * @param entry 替换的表项，可为0
+ */
+static void route_replace(uint32_t *tbl, size_t num, uint8_t depth, uint32_t entry)
+{
+    for (size_t i = 0; i < num; i++)
+        if ((tbl[i] & ROUTE_ENTRY_VALID) && route_entry_depth(tbl[i]) == depth)
+            tbl[i] = entry;
+}
+
+/**
+ * @brief 内部函数，把tbl24的一段范围写入表项，遇到tbl8组时写入组内
+ *
+ * @param begin tbl24起始下标
+ * @param num tbl24表项数
+ * @param depth 前缀长度
+ * @param entry 表项
+ * @param add 1为添加，0为删除替换
+ */
+static void route_tbl24_update(uint32_t begin, uint32_t num, uint8_t depth, uint32_t entry, int add)
+{
+    for (uint32_t i = begin; i < begin + num; i++)
+    {
+        uint32_t *tbl = &route_tbl24[i];
+        size_t tbl_num = 1;
+        if (route_tbl24[i] & ROUTE_ENTRY_EXT)
+        {
+            tbl = &route_tbl8[(route_tbl24[i] & ROUTE_ENTRY_INDEX_MASK) * ROUTE_TBL8_GROUP_SIZE];
+            tbl_num = ROUTE_TBL8_GROUP_SIZE;
+        }
+        if (add)
+            route_fill(tbl, tbl_num, depth, entry);
+        else
+            route_replace(tbl, tbl_num, depth, entry);
+    }
+}
+
+/**
+ * @brief 内部函数，为tbl24表项分配tbl8组，组内继承原表项
+ *
+ * @param index tbl24下标
+ * @return uint32_t* tbl8组，失败为NULL
+ */
+static uint32_t *route_tbl8_alloc(uint32_t index)
+{
+    if (route_tbl24[index] & ROUTE_ENTRY_EXT)
+        return &route_tbl8[(route_tbl24[index] & ROUTE_ENTRY_INDEX_MASK) * ROUTE_TBL8_GROUP_SIZE];
+    if (route_tbl8_free_num == 0)
+        return NULL;
+    uint32_t group = route_tbl8_free[--route_tbl8_free_num];
+    uint32_t *tbl = &route_tbl8[group * ROUTE_TBL8_GROUP_SIZE];
+    for (size_t i = 0; i < ROUTE_TBL8_GROUP_SIZE; i++)
+        tbl[i] = route_tbl24[index];
+    route_tbl24[index] = ROUTE_ENTRY_EXT | group;
+    return tbl;
+}
+
+/**
+ * @brief 内部函数，tbl8组中已没有长度大于24的前缀时，将其合并回tbl24
+ *
+ * @param index tbl24下标
+ */
+static void route_tbl8_try_free(uint32_t index)
+{
+    if (!(route_tbl24[index] & ROUTE_ENTRY_EXT))
+        return;
+    uint32_t group = route_tbl24[index] & ROUTE_ENTRY_INDEX_MASK;
+    uint32_t *tbl = &route_tbl8[group * ROUTE_TBL8_GROUP_SIZE];
+    for (size_t i = 0; i < ROUTE_TBL8_GROUP_SIZE; i++)
+        if ((tbl[i] & ROUTE_ENTRY_VALID) && route_entry_depth(tbl[i]) > 24)
+            return;
+    route_tbl24[index] = tbl[0];
+    route_tbl8_free[route_tbl8_free_num++] = group;
+}
+
+/**
+ * @brief 内部函数，<前缀,长度>的哈希值
+ *
+ * @param addr 主机序前缀
+ * @param prefix_len 前缀长度
+ * @return size_t 哈希槽位
+ */
+static inline size_t route_hash_slot(uint32_t addr, uint8_t prefix_len)
+{
+    uint32_t h = (addr ^ prefix_len) * 0x9E3779B1u;
+    return (h ^ (h >> 15)) & (ROUTE_HASH_NUM - 1);
+}
+
+/**
+ * @brief 内部函数，在哈希索引中查找路由
+ *
+ * @param addr 主机序前缀
+ * @param prefix_len 前缀长度
+ * @return uint32_t* 命中的槽位，未命中为NULL
+ */
+static uint32_t *route_hash_get(uint32_t addr, uint8_t prefix_len)
+{
+    for (size_t i = route_hash_slot(addr, prefix_len);; i = (i + 1) & (ROUTE_HASH_NUM - 1))
+    {
+        if (route_hash[i] == 0)
+            return NULL;
+        route_t *route = &route_rules[route_hash[i] - 1];
+        if (route->prefix_len == prefix_len && route_ip_to_u32(route->prefix) == addr)
+            return &route_hash[i];
+    }
+}
+
+/**
+ * @brief 内部函数，向哈希索引插入路由，调用前需确认其不存在
+ *
+ * @param addr 主机序前缀
+ * @param prefix_len 前缀长度
+ * @param index 规则下标
+ */
+static void route_hash_set(uint32_t addr, uint8_t prefix_len, uint32_t index)
+{
+    size_t i = route_hash_slot(addr, prefix_len);
+    while (route_hash[i] != 0)
+        i = (i + 1) & (ROUTE_HASH_NUM - 1);
+    route_hash[i] = index + 1;
+}
+
+/**
+ * @brief 内部函数，从哈希索引删除一个槽位，并把其后同一探测链上的项前移填补空位
+ *
+ * @param slot 要删除的槽位，由route_hash_get得到
+ */
+static void route_hash_remove(uint32_t *slot)
+{
+    size_t hole = slot - route_hash;
+    route_hash[hole] = 0;
+    for (size_t i = (hole + 1) & (ROUTE_HASH_NUM - 1); route_hash[i] != 0; i = (i + 1) & (ROUTE_HASH_NUM - 1))
+    {
+        route_t *route = &route_rules[route_hash[i] - 1];
+        size_t home = route_hash_slot(route_ip_to_u32(route->prefix), route->prefix_len);
+        // 理想槽位不在(hole, i]之间的项可以移到空位，移走后它原来的位置成为新的空位
+        if (((i - home) & (ROUTE_HASH_NUM - 1)) >= ((i - hole) & (ROUTE_HASH_NUM - 1)))
+        {
+            route_hash[hole] = route_hash[i];
+            route_hash[i] = 0;
+            hole = i;
+        }
+    }
+}
+
+/**
+ * @brief 内部函数，查找已存在的路由
+ *
+ * @param addr 主机序前缀
+ * @param prefix_len 前缀长度
+ * @return int64_t 路由下标，不存在为-1
+ */
+static int64_t route_find(uint32_t addr, uint8_t prefix_len)
+{
+    if (prefix_len == 0)
+        return route_default;
+    uint32_t *slot = route_hash_get(addr, prefix_len);
+    return slot ? (int64_t)*slot - 1 : -1;
+}
+
+/**
+ * @brief 内部函数，计算前缀长度对应的主机序掩码
+ *
+ * @param prefix_len 前缀长度
+ * @return uint32_t 掩码
+ */
+static inline uint32_t route_mask(uint8_t prefix_len)
+{
+    return prefix_len ? ~0u << (32 - prefix_len) : 0;
+}
+
+/**
+ * @brief 初始化路由表
+ *
+ */
+void route_init()
+{
+    // tbl24有64MB，未使用过时本就全0，避免无谓地触碰全部页面
+    if (route_rules_num)
+    {
+        memset(route_tbl24, 0, sizeof(route_tbl24));
+        memset(route_tbl8, 0, sizeof(route_tbl8));
+    }
+    for (size_t i = 0; i < ROUTE_TBL8_GROUP_NUM; i++)
+        route_tbl8_free[i] = ROUTE_TBL8_GROUP_NUM - 1 - i;
+    route_tbl8_free_num = ROUTE_TBL8_GROUP_NUM;
+    memset(route_rules, 0, sizeof(route_rules));
+    memset(route_hash, 0, sizeof(route_hash));
+    route_rules_num = 0;
+    route_rules_free_num = 0;
+    route_num = 0;
+    route_default = -1;
+    route_generation++;
+}
+
+/**
+ * @brief 添加或更新一条等价多路径路由，同一流总是选择同一网关
+ *
+ * @param prefix 目的网络前缀，主机位会被忽略
+ * @param prefix_len 前缀长度，0为默认路由
+ * @param gateways 等价的下一跳网关数组
+ * @param gateway_num 网关数，0表示直连
+ * @param netif 出口网卡
+ * @return int 成功为0，失败为-1
+ */
+int route_add_multipath(const uint8_t *prefix, uint8_t prefix_len, const uint8_t (*gateways)[NET_IP_LEN], size_t gateway_num, net_if_t *netif)
+{
+    if (prefix_len > 32 || gateway_num > ROUTE_MAX_ECMP)
+        return -1;
+    uint32_t addr = route_ip_to_u32(prefix) & route_mask(prefix_len);
+    int64_t index = route_find(addr, prefix_len);
+    if (index < 0)
+    {
+        if (route_rules_free_num)
+            index = route_rules_free[--route_rules_free_num];
+        else if (route_rules_num < ROUTE_MAX_NUM)
+            index = route_rules_num++;
+        else
+            return -1;
+        if (prefix_len > 24 && !route_tbl8_alloc(addr >> 8))
+        {
+            route_rules_free[route_rules_free_num++] = index;
+            return -1;
+        }
+        route_num++;
+    }
+
+    route_t *route = &route_rules[index];
+    for (int i = 0; i < NET_IP_LEN; i++)
+        route->prefix[i] = addr >> (24 - 8 * i);
+    route->prefix_len = prefix_len;
+    route->gateway_num = gateway_num;
+    if (gateway_num)
+        memcpy(route->gateways, gateways, gateway_num * NET_IP_LEN);
+    route->netif = netif;
+    route_generation++;
+    if (!route->valid && prefix_len)
+        route_hash_set(addr, prefix_len, index);
+    route->valid = 1;
+
+    uint32_t entry = route_entry(prefix_len, index);
+    if (prefix_len == 0)
+        route_default = index;
+    else if (prefix_len <= 24)
+        route_tbl24_update(addr >> 8, 1u << (24 - prefix_len), prefix_len, entry, 1);
+    else
+        route_fill(&route_tbl8[(route_tbl24[addr >> 8] & ROUTE_ENTRY_INDEX_MASK) * ROUTE_TBL8_GROUP_SIZE + (addr & 0xFF)],
+                   1u << (32 - prefix_len), prefix_len, entry);
+    return 0;
+}
+
+/**
+ * @brief 添加或更新一条单一下一跳的路由
+ *
+ * @param prefix 目的网络前缀，主机位会被忽略
+ * @param prefix_len 前缀长度，0为默认路由
+ * @param gateway 下一跳网关，NULL或全0表示直连
+ * @param netif 出口网卡
+ * @return int 成功为0，失败为-1
+ */
+int route_add(const uint8_t *prefix, uint8_t prefix_len, const uint8_t *gateway, net_if_t *netif)
+{
+    static const uint8_t zero_ip[NET_IP_LEN] = {0};
+    if (gateway == NULL || !memcmp(gateway, zero_ip, NET_IP_LEN))
+        return route_add_multipath(prefix, prefix_len, NULL, 0, netif);
+    return route_add_multipath(prefix, prefix_len, (const uint8_t(*)[NET_IP_LEN])gateway, 1, netif);
+}
+
+/**
+ * @brief 删除一条路由，被覆盖的地址回落到次长的前缀
+ *
+ * @param prefix 目的网络前缀
+ * @param prefix_len 前缀长度
+ * @return int 成功为0，不存在为-1
+ */
+int route_delete(const uint8_t *prefix, uint8_t prefix_len)
+{
+    if (prefix_len > 32)
+        return -1;
+    uint32_t addr = route_ip_to_u32(prefix) & route_mask(prefix_len);
+    int64_t index = route_find(addr, prefix_len);
+    if (index < 0)
+        return -1;
+    route_rules[index].valid = 0;
+    route_rules_free[route_rules_free_num++] = index;
+    route_generation++;
+    route_num--;
+    if (prefix_len == 0)
+    {
+        route_default = -1;
+        return 0;
+    }
+    route_hash_remove(route_hash_get(addr, prefix_len));
+
+    // 寻找覆盖该前缀的次长路由，默认路由不展开，无需考虑
+    uint32_t replace = 0;
+    for (uint8_t len = prefix_len - 1; len > 0 && !replace; len--)
+    {
+        int64_t cover = route_find(addr & route_mask(len), len);
+        if (cover >= 0)
+            replace = route_entry(len, cover);
+    }
+
+    if (prefix_len <= 24)
+        route_tbl24_update(addr >> 8, 1u << (24 - prefix_len), prefix_len, replace, 0);
+    else
+    {
+        route_replace(&route_tbl8[(route_tbl24[addr >> 8] & ROUTE_ENTRY_INDEX_MASK) * ROUTE_TBL8_GROUP_SIZE + (addr & 0xFF)],
+                      1u << (32 - prefix_len), prefix_len, replace);
+        route_tbl8_try_free(addr >> 8);
+    }
+    return 0;
+}
+
+/**
+ * @brief 最长前缀匹配查找路由，最多访问两次表
+ *
+ * @param ip 目的ip地址
+ * @return route_t* 命中的路由，无路由为NULL
+ */
+route_t *route_lookup(const uint8_t *ip)
+{
+    uint32_t entry = route_entry_get(route_ip_to_u32(ip));
+    if (entry & ROUTE_ENTRY_VALID)
+        return &route_rules[entry & ROUTE_ENTRY_INDEX_MASK];
+    return route_default < 0 ? NULL : &route_rules[route_default];
+}
+
+/**
+ * @brief 解析目的地址的下一跳，多条等价网关时按流哈希选择，保证同一流不乱序
+ *
+ * @param route 目的地址命中的路由，由route_lookup得到
+ * @param ip 目的ip地址
+ * @param flow_hash 数据包所属流的哈希值
+ * @return uint8_t* 直连时为ip本身，否则为网关地址
+ */
+uint8_t *route_next_hop(route_t *route, uint8_t *ip, uint32_t flow_hash)
+{
+    if (route->gateway_num == 0)
+        return ip;
+    return route->gateways[flow_hash % route->gateway_num];
+}
+
+/**
+ * @brief 获取有效路由数
+ *
+ * @return size_t 路由数
+ */
+size_t route_size()
+{
+    return route_num;
+}
+
+/**
+ * @brief 打印整个路由表
+ *
+ */
+void route_print()
+{
+    printf("===ROUTE TABLE BEGIN===\n");
+    for (size_t i = 0; i < route_rules_num; i++)
+    {
+        route_t *route = &route_rules[i];
+        if (!route->valid)
+            continue;
+        printf("%s/%u", iptos(route->prefix), route->prefix_len);
+        if (route->gateway_num == 0)
+            printf(" directly connected");
+        for (size_t j = 0; j < route->gateway_num; j++)
+            printf(" via %s", iptos(route->gateways[j]));
+        if (route->netif)
+            printf(" dev %s", route->netif->name);
+        printf("\n");
+    }
+    printf("===ROUTE TABLE  END ===\n");
+}
@@ -1,12 +1,370 @@
 #include "udp.h"
 #include "ip.h"
 #include "icmp.h"
+#include "driver.h"
 
 /**
- * @brief udp处理程序表
+ * @brief 打开的udp端口
  *
  */
-map_t udp_table;
+static NET_TLS udp_socket_t udp_sockets[UDP_MAX_SOCKET];
+
+/**
+ * @brief udp端口哈希表，按本地端口散列，同一链上的端口按打开顺序排列
+ *
+ */
+static NET_TLS udp_socket_t *udp_hash[UDP_HASH_NUM];
+#define UDP_HASH_SLOT(port) (&udp_hash[(port) & (UDP_HASH_NUM - 1)])
+
+/**
+ * @brief 临时端口位图，置位表示端口已被占用，包括显式打开的临时范围内的端口
+ *
+ */
+#define UDP_EPHEMERAL_NUM (UDP_EPHEMERAL_MAX - UDP_EPHEMERAL_MIN + 1)
+static NET_TLS uint64_t udp_ephemeral_bitmap[(UDP_EPHEMERAL_NUM + 63) / 64];
+static NET_TLS size_t udp_ephemeral_used;
+static NET_TLS uint64_t udp_ephemeral_rand;
+
+/**
+ * @brief 有待发数据的塞住端口数，以及发出合并数据报用的缓冲区
+ *        合并的数据报不能用txbuf发送，因为追加时txbuf中可能正是要追加的数据
+ *
+ */
+static NET_TLS size_t udp_corked_num;
+static NET_TLS buf_t udp_cork_buf;
+
+typedef struct udp_dgram //接收环中的一个数据报
+{
+    buf_meta_t meta;                // 收到时的元数据，含对端地址
+    uint16_t len;                   // 数据长度
+    uint8_t data[UDP_RECV_MAX_LEN]; // 数据
+} udp_dgram_t;
+
+/**
+ * @brief 一轮轮询中暂存的待合并递交的数据报，rxbuf会被下一个包覆盖，因此需要复制
+ *
+ */
+static NET_TLS udp_dgram_t udp_gro_dgrams[UDP_GRO_MAX];
+static NET_TLS udp_socket_t *udp_gro_socks[UDP_GRO_MAX];
+static NET_TLS size_t udp_gro_num;
+
+/**
+ * @brief 正在递交给回调模式处理程序的数据报的元数据
+ *
+ */
+static NET_TLS const buf_meta_t *udp_rx_meta;
+
+/**
+ * @brief 按最具体匹配查找接收数据报的端口
+ *        先找连接到该对端的端口，再找未连接的监听端口，reuseport组内按流哈希选择，同一流总是选中同一端口
+ *
+ * @param port 本地端口号
+ * @param remote_ip 对端ip地址
+ * @param remote_port 对端端口号
+ * @param hash 流哈希
+ * @return udp_socket_t* 端口，未打开为NULL
+ */
+static udp_socket_t *udp_lookup(uint16_t port, uint8_t *remote_ip, uint16_t remote_port, uint32_t hash)
+{
+    udp_socket_t *listener = NULL;
+    size_t listener_num = 0;
+    for (udp_socket_t *sock = *UDP_HASH_SLOT(port); sock; sock = sock->next)
+    {
+        if (sock->port != port)
+            continue;
+        if (!sock->connected)
+        {
+            if (listener == NULL)
+                listener = sock;
+            listener_num++;
+        }
+        else if (sock->peer.port == remote_port && !memcmp(sock->peer.ip, remote_ip, NET_IP_LEN))
+            return sock;
+    }
+    if (listener_num <= 1)
+        return listener;
+    size_t index = hash % listener_num;
+    for (udp_socket_t *sock = listener;; sock = sock->next)
+        if (sock->port == port && !sock->connected && index-- == 0)
+            return sock;
+}
+
+/**
+ * @brief 查找本地端口上第一个未连接的监听端口
+ *
+ * @param port 本地端口号
+ * @return udp_socket_t* 端口，没有为NULL
+ */
+static udp_socket_t *udp_listener_find(uint16_t port)
+{
+    for (udp_socket_t *sock = *UDP_HASH_SLOT(port); sock; sock = sock->next)
+        if (sock->port == port && !sock->connected)
+            return sock;
+    return NULL;
+}
+
+/**
+ * @brief 在临时端口位图中标记端口已占用，范围外的端口忽略
+ *
+ * @param port 端口号
+ */
+static void udp_port_reserve(uint16_t port)
+{
+    if (port < UDP_EPHEMERAL_MIN || port > UDP_EPHEMERAL_MAX)
+        return;
+    size_t bit = port - UDP_EPHEMERAL_MIN;
+    if (!(udp_ephemeral_bitmap[bit / 64] & (1ull << (bit % 64))))
+    {
+        udp_ephemeral_bitmap[bit / 64] |= 1ull << (bit % 64);
+        udp_ephemeral_used++;
+    }
+}
+
+/**
+ * @brief 在临时端口位图中释放端口，范围外的端口忽略
+ *
+ * @param port 端口号
+ */
+static void udp_port_release(uint16_t port)
+{
+    if (port < UDP_EPHEMERAL_MIN || port > UDP_EPHEMERAL_MAX)
+        return;
+    size_t bit = port - UDP_EPHEMERAL_MIN;
+    if (udp_ephemeral_bitmap[bit / 64] & (1ull << (bit % 64)))
+    {
+        udp_ephemeral_bitmap[bit / 64] &= ~(1ull << (bit % 64));
+        udp_ephemeral_used--;
+    }
+}
+
+/**
+ * @brief 分配一个空闲的临时端口
+ *        从随机位置开始按64位字查找空闲位，使端口难以预测，占用率不高时通常第一个字即可命中
+ *
+ * @return uint16_t 端口号，临时端口耗尽为0
+ */
+static uint16_t udp_port_alloc()
+{
+    if (udp_ephemeral_used >= UDP_EPHEMERAL_NUM)
+        return 0;
+    if (udp_ephemeral_rand == 0)
+        udp_ephemeral_rand = time_us() | 1;
+    udp_ephemeral_rand ^= udp_ephemeral_rand << 13;
+    udp_ephemeral_rand ^= udp_ephemeral_rand >> 7;
+    udp_ephemeral_rand ^= udp_ephemeral_rand << 17;
+    size_t start = udp_ephemeral_rand % UDP_EPHEMERAL_NUM;
+    size_t words = sizeof(udp_ephemeral_bitmap) / sizeof(uint64_t);
+    for (size_t i = 0; i <= words; i++)
+    {
+        size_t word = (start / 64 + i) % words;
+        uint64_t free_bits = ~udp_ephemeral_bitmap[word];
+        // 起始字中只取起点之后的位，绕回一圈后再取之前的位
+        if (i == 0)
+            free_bits &= ~0ull << (start % 64);
+        // 最后一个字中超出范围的位不可用
+        if (word == words - 1 && UDP_EPHEMERAL_NUM % 64)
+            free_bits &= (1ull << (UDP_EPHEMERAL_NUM % 64)) - 1;
+        if (free_bits)
+        {
+            uint16_t port = UDP_EPHEMERAL_MIN + word * 64 + __builtin_ctzll(free_bits);
+            udp_port_reserve(port);
+            return port;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 分配一个udp端口并挂到哈希链尾
+ *
+ * @param port 本地端口号，0为分配临时端口
+ * @return udp_socket_t* 端口，表满为NULL
+ */
+static udp_socket_t *udp_socket_new(uint16_t port)
+{
+    udp_socket_t *sock = NULL;
+    for (size_t i = 0; i < UDP_MAX_SOCKET && !sock; i++)
+        if (!udp_sockets[i].used)
+            sock = &udp_sockets[i];
+    if (sock == NULL)
+        return NULL;
+    if (port == 0)
+        port = udp_port_alloc();
+    else
+        udp_port_reserve(port);
+    if (port == 0)
+        return NULL;
+    memset(sock, 0, sizeof(udp_socket_t));
+    sock->port = port;
+    sock->used = 1;
+    udp_socket_t **tail = UDP_HASH_SLOT(port);
+    while (*tail)
+        tail = &(*tail)->next;
+    *tail = sock;
+    return sock;
+}
+
+/**
+ * @brief 分配一个监听端口
+ *        非reuseport的端口重复打开时替换原端口；reuseport端口加入同一端口的组，两种端口不能共存
+ *
+ * @param port 本地端口号
+ * @param reuseport 是否加入reuseport组
+ * @return udp_socket_t* 端口，表满或与已有端口冲突为NULL
+ */
+static udp_socket_t *udp_socket_alloc(uint16_t port, int reuseport)
+{
+    udp_socket_t *old = port ? udp_listener_find(port) : NULL;
+    if (old && old->reuseport != reuseport)
+        return NULL;
+    if (old && !reuseport)
+        udp_sock_close(old);
+    udp_socket_t *sock = udp_socket_new(port);
+    if (sock)
+        sock->reuseport = reuseport;
+    return sock;
+}
+
+/**
+ * @brief 为端口创建接收环
+ *
+ * @param sock 端口
+ * @param depth 接收环深度，0为UDP_RECV_DEPTH
+ * @param overflow 接收环满时的丢弃策略
+ * @return udp_socket_t* 端口，内存不足时关闭端口并返回NULL
+ */
+static udp_socket_t *udp_socket_ring_init(udp_socket_t *sock, uint32_t depth, udp_overflow_t overflow)
+{
+    if (sock && ring_init(&sock->ring, sizeof(udp_dgram_t), depth ? depth : UDP_RECV_DEPTH) < 0)
+    {
+        udp_sock_close(sock);
+        return NULL;
+    }
+    if (sock)
+        sock->overflow = overflow;
+    return sock;
+}
+
+/**
+ * @brief 将数据报放入端口的接收环，环满时按端口的策略丢弃
+ *
+ * @param sock 端口
+ * @param buf 数据报，data指向udp数据，元数据中含对端地址
+ */
+static void udp_enqueue(udp_socket_t *sock, buf_t *buf)
+{
+    if (buf->len > UDP_RECV_MAX_LEN)
+    {
+        sock->stats.rx_too_big++;
+        return;
+    }
+    udp_dgram_t *dgram = ring_enqueue_slot(&sock->ring);
+    if (dgram == NULL && sock->overflow == UDP_OVERFLOW_DROP_OLDEST)
+    {
+        // 丢弃失败说明应用刚好取走了数据报，环已不满
+        if (ring_drop_oldest(&sock->ring) == 0)
+            sock->stats.rx_dropped++;
+        dgram = ring_enqueue_slot(&sock->ring);
+    }
+    if (dgram == NULL)
+    {
+        sock->stats.rx_dropped++;
+        return;
+    }
+    dgram->meta = buf->meta;
+    dgram->len = buf->len;
+    memcpy(dgram->data, buf->data, buf->len);
+    ring_enqueue_commit(&sock->ring);
+    sock->stats.rx_packets++;
+    sock->stats.rx_bytes += buf->len;
+}
+
+/**
+ * @brief 暂存一个待合并递交的数据报，暂存区满时先递交已暂存的
+ *
+ * @param sock 端口
+ * @param buf 数据报，data指向udp数据，元数据中含对端地址
+ */
+static void udp_gro_stage(udp_socket_t *sock, buf_t *buf)
+{
+    if (buf->len > UDP_RECV_MAX_LEN)
+    {
+        sock->stats.rx_too_big++;
+        return;
+    }
+    if (udp_gro_num == UDP_GRO_MAX)
+        udp_gro_flush();
+    udp_dgram_t *dgram = &udp_gro_dgrams[udp_gro_num];
+    dgram->meta = buf->meta;
+    dgram->len = buf->len;
+    memcpy(dgram->data, buf->data, buf->len);
+    udp_gro_socks[udp_gro_num++] = sock;
+    sock->stats.rx_packets++;
+    sock->stats.rx_bytes += buf->len;
+}
+
+/**
+ * @brief 递交暂存的数据报，由net_poll在每轮结束时调用
+ *        同一端口同一对端的数据报按到达顺序合并为一个数组，每个流只调用一次合并递交的处理程序
+ *        不可重入：处理程序中不能轮询，msgs指向暂存区，嵌套暂存或递交会覆盖尚未递交的数据报
+ *
+ */
+void udp_gro_flush()
+{
+    static NET_TLS udp_msg_t msgs[UDP_GRO_MAX];
+    static NET_TLS uint8_t done[UDP_GRO_MAX];
+    size_t num = udp_gro_num;
+    udp_gro_num = 0;
+    memset(done, 0, num);
+    for (size_t i = 0; i < num; i++)
+    {
+        if (done[i])
+            continue;
+        udp_socket_t *sock = udp_gro_socks[i];
+        int n = 0;
+        for (size_t j = i; j < num; j++)
+        {
+            udp_dgram_t *dgram = &udp_gro_dgrams[j];
+            if (done[j] || udp_gro_socks[j] != sock || dgram->meta.src_port != udp_gro_dgrams[i].meta.src_port ||
+                memcmp(dgram->meta.src_ip, udp_gro_dgrams[i].meta.src_ip, NET_IP_LEN))
+                continue;
+            done[j] = 1;
+            msgs[n].data = dgram->data;
+            msgs[n].len = dgram->len;
+            memcpy(msgs[n].ip, dgram->meta.src_ip, NET_IP_LEN);
+            msgs[n].port = dgram->meta.src_port;
+            msgs[n].meta = dgram->meta;
+            n++;
+        }
+        // 端口可能已在之前的处理程序中关闭
+        if (sock->used && sock->batch_handler)
+            sock->batch_handler(sock, msgs, n);
+    }
+}
+
+/**
+ * @brief 获取正在递交的数据报的元数据，供回调模式的处理程序读取目的地址、接收时间等
+ *        接收环与合并递交模式的元数据随udp_msg_t返回
+ *
+ * @return const buf_meta_t* 元数据，不在处理程序中调用时为NULL
+ */
+const buf_meta_t *udp_current_meta()
+{
+    return udp_rx_meta;
+}
+
+/**
+ * @brief 为端口设置合并递交的处理程序
+ *        一轮轮询中同一对端发来的数据报被合并为一个数组，在轮询结束时一次递交，减少每个数据报的调用开销，
+ *        数组只在处理程序中有效，处理程序中可以发送和关闭端口，但不能轮询
+ *
+ * @param sock 端口
+ * @param handler 合并递交的处理程序，NULL为取消
+ */
+void udp_set_batch_handler(udp_socket_t *sock, udp_batch_handler_t handler)
+{
+    sock->batch_handler = handler;
+}
 
 /**
  * @brief udp伪校验和计算
@@ -55,13 +413,26 @@ static uint16_t udp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip)
     return checksum;
 }
 
+/**
+ * @brief 把udp_checksum等得到的主机字节序校验和转为首部中的网络字节序
+ *        计算结果为0时填0xFFFF，因为首部中的0表示发送方未计算校验和
+ *
+ * @param checksum 主机字节序的校验和
+ * @return uint16_t 首部校验和字段的值
+ */
+static uint16_t udp_checksum_field(uint16_t checksum)
+{
+    return swap16(checksum ? checksum : 0xFFFF);
+}
+
 /**
  * @brief 处理一个收到的udp数据包
  *
  * @param buf 要处理的包
  * @param src_ip 源ip地址
+ * @param netif 收到数据包的网卡
  */
-void udp_in(buf_t *buf, uint8_t *src_ip)
+void udp_in(buf_t *buf, uint8_t *src_ip, net_if_t *netif)
 {
     // TO-DO
     // 如果数据包的长度小于udp头部长度，则直接返回
@@ -72,33 +443,89 @@ void udp_in(buf_t *buf, uint8_t *src_ip)
     // 如果udp头部的总长度小于udp头部长度，则直接返回
     if (swap16(udp_header->total_len16) < sizeof(udp_hdr_t))
         return;
-    // 获取udp头部的校验和
+    // 获取udp头部的校验和，为0表示发送方未计算，不需要校验
     uint16_t pre_checksum = udp_header->checksum16;
-    // 将udp头部的校验和置为0
-    udp_header->checksum16 = 0;
-    // 计算udp校验和
-    uint16_t now_checksum = udp_checksum(buf, src_ip, net_if_ip);
-    // 如果计算出的校验和与原校验和不一致，则直接返回
-    if (now_checksum != pre_checksum)
-        return;
-    // 将udp头部的校验和置为原校验和
-    udp_header->checksum16 = pre_checksum;
-    // 获取udp目标端口
+    if (pre_checksum)
+    {
+        // 将udp头部的校验和置为0
+        udp_header->checksum16 = 0;
+        // 计算udp校验和，目的地址取自ip层填写的元数据
+        uint16_t now_checksum = udp_checksum(buf, src_ip, buf->meta.dst_ip);
+        // 将udp头部的校验和置为原校验和
+        udp_header->checksum16 = pre_checksum;
+        // 如果计算出的校验和与原校验和不一致，则直接返回
+        if (udp_checksum_field(now_checksum) != pre_checksum)
+            return;
+    }
+    // 获取udp目标端口，与流哈希一起记入元数据
     uint16_t dst_port = swap16(udp_header->dst_port16);
-    // 获取udp处理函数
-    udp_handler_t *handler = map_get(&udp_table, &dst_port);
-    // 如果udp处理函数为空，则添加ip头，发送ICMP端口不可达报文
-    if (!handler)
+    uint16_t src_port = swap16(udp_header->src_port16);
+    buf->meta.l4_off = buf->data - buf->payload;
+    buf->meta.src_port = src_port;
+    buf->meta.dst_port = dst_port;
+    buf->meta.csum |= BUF_CSUM_L4;
+    buf->meta.flow_hash = flow_hash(src_ip, buf->meta.dst_ip, NET_PROTOCOL_UDP, src_port, dst_port);
+    // 按四元组查找打开的端口
+    udp_socket_t *sock = udp_lookup(dst_port, src_ip, src_port, buf->meta.flow_hash);
+    // 如果端口未打开，则恢复到ip首部，发送ICMP端口不可达报文
+    if (!sock)
     {
-        buf_add_header(buf, sizeof(ip_hdr_t));
+        buf_add_header(buf, buf->data - (buf->payload + buf->meta.l3_off));
         icmp_unreachable(buf, src_ip, ICMP_CODE_PORT_UNREACH);
+        return;
     }
-    // 否则，删除udp头部，调用udp处理函数
-    else
+    // 否则，删除udp头部，调用处理函数或放入接收环
+    buf_remove_header(buf, sizeof(udp_hdr_t));
+    if (sock->batch_handler)
+        udp_gro_stage(sock, buf);
+    else if (sock->handler)
     {
-        buf_remove_header(buf, sizeof(udp_hdr_t));
-        (*handler)(buf->data, buf->len, src_ip, swap16(udp_header->dst_port16));
+        udp_rx_meta = &buf->meta;
+        sock->handler(buf->data, buf->len, src_ip, src_port);
+        udp_rx_meta = NULL;
     }
+    else
+        udp_enqueue(sock, buf);
+}
+
+/**
+ * @brief 处理一个引用了本机udp数据报的icmp目的不可达报文
+ *
+ * @param buf 要处理的包，data指向icmp报文中引用的原ip首部
+ * @param code icmp代码，如ICMP_CODE_PORT_UNREACH
+ */
+void udp_err_in(buf_t *buf, uint8_t code)
+{
+    // 引用部分至少包含原ip首部与udp首部的端口
+    ip_hdr_t *orig_hdr = (ip_hdr_t *)buf->data;
+    size_t hdr_len = orig_hdr->hdr_len * IP_HDR_LEN_PER_BYTE;
+    if (hdr_len < sizeof(ip_hdr_t) || buf->len < hdr_len + sizeof(udp_hdr_t))
+        return;
+    udp_hdr_t *udp_header = (udp_hdr_t *)(buf->data + hdr_len);
+    // 原数据报的源端口即本地端口，按对端发来的方向查找，与接收该流的端口一致
+    uint16_t port = swap16(udp_header->src_port16);
+    uint16_t dst_port = swap16(udp_header->dst_port16);
+    udp_socket_t *sock = udp_lookup(port, orig_hdr->dst_ip, dst_port, flow_hash(orig_hdr->dst_ip, orig_hdr->src_ip, NET_PROTOCOL_UDP, dst_port, port));
+    if (sock && sock->err_handler)
+        sock->err_handler(port, orig_hdr->dst_ip, dst_port, code);
+}
+
+/**
+ * @brief 将填好首部的udp数据报交给ip层发送
+ *        默认置DF位，由调用者按udp_mtu控制数据报大小
+ *
+ * @param buf 要发送的数据报
+ * @param dst_ip 目的ip地址
+ * @return int 成功为0，无路由或超过路径mtu为-1
+ */
+static int udp_ip_out(buf_t *buf, uint8_t *dst_ip)
+{
+#if UDP_DONT_FRAGMENT
+    return ip_out_df(buf, dst_ip, NET_PROTOCOL_UDP);
+#else
+    ip_out(buf, dst_ip, NET_PROTOCOL_UDP);
+    return 0;
+#endif
 }
 
 /**
@@ -108,8 +535,9 @@ void udp_in(buf_t *buf, uint8_t *src_ip)
  * @param src_port 源端口号
  * @param dst_ip 目的ip地址
  * @param dst_port 目的端口号
+ * @return int 成功为0，无路由或超过路径mtu为-1
  */
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+int udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
 {
     // TO-DO
     // 向缓冲区添加一个UDP头
@@ -124,11 +552,24 @@ void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
     udp_header->total_len16 = swap16(buf->len);
     // 设置校验和为0
     udp_header->checksum16 = 0;
-    // 计算校验和
-    udp_header->checksum16 = udp_checksum(buf, net_if_ip, dst_ip);
-    // 发送数据包
-    ip_out(buf, dst_ip, NET_PROTOCOL_UDP);
-    return;
+    // 计算校验和，源地址为路由出口网卡上的地址，无路由则丢弃
+    uint8_t *src_ip = ip_src_addr(dst_ip);
+    if (src_ip == NULL)
+        return -1;
+    udp_header->checksum16 = udp_checksum_field(udp_checksum(buf, src_ip, dst_ip));
+    return udp_ip_out(buf, dst_ip);
+}
+
+/**
+ * @brief 获取发往目的地址时不会被分片的最大udp数据长度
+ *
+ * @param dst_ip 目的ip地址
+ * @return uint16_t 最大数据长度，无路由为0
+ */
+uint16_t udp_mtu(uint8_t *dst_ip)
+{
+    uint16_t mtu = ip_mtu(dst_ip);
+    return mtu ? mtu - sizeof(ip_hdr_t) - sizeof(udp_hdr_t) : 0;
 }
 
 /**
@@ -137,30 +578,199 @@ void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
  */
 void udp_init()
 {
-    map_init(&udp_table, sizeof(uint16_t), sizeof(udp_handler_t), 0, 0, NULL);
     net_add_protocol(NET_PROTOCOL_UDP, udp_in);
 }
 
 /**
  * @brief 打开一个udp端口并注册处理程序
  *
- * @param port 端口号
+ * @param port 端口号，0为分配临时端口
  * @param handler 处理程序
- * @return int 成功为0，失败为-1
+ * @return int 成功为打开的端口号，失败为-1
  */
 int udp_open(uint16_t port, udp_handler_t handler)
 {
-    return map_set(&udp_table, &port, &handler);
+    udp_socket_t *sock = udp_socket_alloc(port, 0);
+    if (sock == NULL)
+        return -1;
+    sock->handler = handler;
+    return sock->port;
+}
+
+/**
+ * @brief 打开一个带接收环的udp端口
+ *        数据报被复制进接收环后立即返回，应用可在其他线程或稍后用udp_recv/udp_recv_batch取出，
+ *        协议栈收包线程与应用各为环的唯一生产者与消费者，因此无需加锁
+ *
+ * @param port 端口号，0为分配临时端口
+ * @param depth 接收环深度，向上取整到2的幂，0为UDP_RECV_DEPTH
+ * @param overflow 接收环满时的丢弃策略
+ * @return udp_socket_t* 端口，表满或内存不足为NULL
+ */
+udp_socket_t *udp_socket(uint16_t port, uint32_t depth, udp_overflow_t overflow)
+{
+    return udp_socket_ring_init(udp_socket_alloc(port, 0), depth, overflow);
 }
 
 /**
- * @brief 关闭一个udp端口
+ * @brief 打开一个加入reuseport组的带接收环的udp端口
+ *        同一端口的多个reuseport端口按流哈希分担收到的数据报，同一流总是进入同一端口的接收环，
+ *        可让多个工作线程或处理程序各自消费一部分流
+ *
+ * @param port 端口号，0为分配临时端口
+ * @param depth 接收环深度，向上取整到2的幂，0为UDP_RECV_DEPTH
+ * @param overflow 接收环满时的丢弃策略
+ * @return udp_socket_t* 端口，表满、内存不足或端口已被非reuseport端口占用为NULL
+ */
+udp_socket_t *udp_socket_reuseport(uint16_t port, uint32_t depth, udp_overflow_t overflow)
+{
+    return udp_socket_ring_init(udp_socket_alloc(port, 1), depth, overflow);
+}
+
+/**
+ * @brief 关闭一个udp端口并发出塞住时的待发数据，调用者须保证此后不再访问该端口的接收环
+ *
+ * @param sock 端口
+ */
+void udp_sock_close(udp_socket_t *sock)
+{
+    udp_socket_t **link = UDP_HASH_SLOT(sock->port);
+    while (*link && *link != sock)
+        link = &(*link)->next;
+    if (*link)
+        *link = sock->next;
+    udp_sock_flush(sock);
+    if (sock->ring.slots)
+        ring_free(&sock->ring);
+    sock->used = 0;
+    // 端口上的最后一个端口关闭后释放端口号
+    for (udp_socket_t *other = *UDP_HASH_SLOT(sock->port); other; other = other->next)
+        if (other->port == sock->port)
+            return;
+    udp_port_release(sock->port);
+}
+
+/**
+ * @brief 关闭本地端口号上的全部udp端口
  *
  * @param port 端口号
  */
 void udp_close(uint16_t port)
 {
-    map_delete(&udp_table, &port);
+    udp_socket_t **link = UDP_HASH_SLOT(port);
+    while (*link)
+    {
+        if ((*link)->port == port)
+            udp_sock_close(*link);
+        else
+            link = &(*link)->next;
+    }
+}
+
+/**
+ * @brief 从端口的接收环取出一个数据报
+ *
+ * @param sock 端口
+ * @param data 数据缓冲区，数据报长于缓冲区时多余部分被丢弃
+ * @param len 缓冲区大小
+ * @param src_ip 返回源ip地址，可为NULL
+ * @param src_port 返回源端口，可为NULL
+ * @return int 复制的数据长度，接收环为空为-1
+ */
+int udp_recv(udp_socket_t *sock, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t *src_port)
+{
+    udp_msg_t msg = {.data = data, .len = len};
+    if (udp_recv_batch(sock, &msg, 1) < 1)
+        return -1;
+    if (src_ip)
+        memcpy(src_ip, msg.ip, NET_IP_LEN);
+    if (src_port)
+        *src_port = msg.port;
+    return msg.len;
+}
+
+/**
+ * @brief 从端口的接收环批量取出数据报
+ *
+ * @param sock 端口
+ * @param msgs 数据报数组，每项的data与len为调用者提供的缓冲区，返回时填写长度与对端地址
+ * @param n 数组长度
+ * @return int 取出的数据报数，接收环为空为0
+ */
+int udp_recv_batch(udp_socket_t *sock, udp_msg_t *msgs, int n)
+{
+    int count = 0;
+    if (sock->ring.slots == NULL)
+        return 0;
+    while (count < n)
+    {
+        udp_dgram_t *dgram = ring_dequeue_slot(&sock->ring);
+        if (dgram == NULL)
+            break;
+        udp_msg_t *msg = &msgs[count];
+        size_t len = dgram->len;
+        // 读取期间可能被DROP_OLDEST策略覆盖，长度先限制在合法范围，出队失败则重读
+        if (len > UDP_RECV_MAX_LEN)
+            len = UDP_RECV_MAX_LEN;
+        if (len > msg->len)
+            len = msg->len;
+        memcpy(msg->data, dgram->data, len);
+        memcpy(msg->ip, dgram->meta.src_ip, NET_IP_LEN);
+        msg->port = dgram->meta.src_port;
+        msg->meta = dgram->meta;
+        if (ring_dequeue_commit(&sock->ring) < 0)
+            continue;
+        msg->len = len;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief 为本地端口号上已打开的全部udp端口注册差错处理程序
+ *        对端端口关闭、主机不可达等icmp差错会回调该程序，应用据此停止向失效的对端发送
+ *
+ * @param port 端口号
+ * @param handler 差错处理程序，NULL表示取消
+ * @return int 成功为0，端口未打开为-1
+ */
+int udp_set_err_handler(uint16_t port, udp_err_handler_t handler)
+{
+    int found = 0;
+    for (udp_socket_t *sock = *UDP_HASH_SLOT(port); sock; sock = sock->next)
+        if (sock->port == port)
+        {
+            sock->err_handler = handler;
+            found = 1;
+        }
+    return found ? 0 : -1;
+}
+
+/**
+ * @brief 分配一个待发送的udp数据缓冲区
+ *        数据前已留出udp、ip与以太网首部的空间，应用直接把数据写入buf->data，
+ *        再用udp_commit_tx发送，数据只写一次；缓冲区即txbuf，须在下一次发送前提交
+ *
+ * @param len 数据长度
+ * @return buf_t* 缓冲区，长度超过缓冲区容量为NULL
+ */
+buf_t *udp_alloc_tx(uint16_t len)
+{
+    return buf_init(&txbuf, len) < 0 ? NULL : &txbuf;
+}
+
+/**
+ * @brief 发送udp_alloc_tx分配并已填好数据的缓冲区
+ *
+ * @param buf udp_alloc_tx返回的缓冲区
+ * @param src_port 源端口号
+ * @param dst_ip 目的ip地址
+ * @param dst_port 目的端口号
+ * @return int 成功为0，无路由或数据超过udp_mtu为-1
+ */
+int udp_commit_tx(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+{
+    return udp_out(buf, src_port, dst_ip, dst_port);
 }
 
 /**
@@ -171,10 +781,354 @@ void udp_close(uint16_t port)
  * @param src_port 源端口号
  * @param dst_ip 目的ip地址
  * @param dst_port 目的端口号
+ * @return int 成功为0，无路由或数据超过udp_mtu为-1
+ */
+int udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+{
+    buf_t *buf = udp_alloc_tx(len);
+    if (buf == NULL)
+        return -1;
+    memcpy(buf->data, data, len);
+    return udp_commit_tx(buf, src_port, dst_ip, dst_port);
+}
+
+/**
+ * @brief 按当前路由与arp表生成已连接端口的首部模板与校验和部分和
+ *
+ * @param sock 已连接的端口
+ */
+static void udp_peer_resolve(udp_socket_t *sock)
+{
+    udp_peer_t *peer = &sock->peer;
+    peer->resolved = 0;
+    if (ip_path_resolve(&peer->path, peer->ip, NET_PROTOCOL_UDP, sock->port, peer->port, UDP_DONT_FRAGMENT) != 0)
+        return;
+    ether_hdr_t *ether_hdr = (ether_hdr_t *)peer->hdr;
+    memcpy(ether_hdr->dst, peer->path.mac, NET_MAC_LEN);
+    memcpy(ether_hdr->src, peer->path.netif->mac, NET_MAC_LEN);
+    ether_hdr->protocol16 = swap16(NET_PROTOCOL_IP);
+    ip_hdr_t *ip_hdr = (ip_hdr_t *)(ether_hdr + 1);
+    memcpy(ip_hdr, &peer->path.hdr, sizeof(ip_hdr_t));
+    udp_hdr_t *udp_header = (udp_hdr_t *)(ip_hdr + 1);
+    udp_header->src_port16 = swap16(sock->port);
+    udp_header->dst_port16 = swap16(peer->port);
+    udp_header->total_len16 = 0;
+    udp_header->checksum16 = 0;
+    // 长度、标识与校验和字段为0，发送时只需累加这几个字段与数据
+    peer->ip_sum = checksum32_add(0, (uint8_t *)ip_hdr, sizeof(ip_hdr_t));
+    peer->pseudo_sum = checksum32_add(0, ip_hdr->src_ip, NET_IP_LEN);
+    peer->pseudo_sum = checksum32_add(peer->pseudo_sum, ip_hdr->dst_ip, NET_IP_LEN);
+    peer->pseudo_sum += NET_PROTOCOL_UDP + sock->port + peer->port;
+    peer->resolved = 1;
+}
+
+/**
+ * @brief 打开一个连接到对端的udp端口，接收环为默认深度
+ *        已连接端口只接收该对端发来的数据报，优先于同一本地端口上的监听端口；同一四元组已打开时返回原端口
+ *        连接时预先生成以太网、ip与udp首部模板与伪首部校验和，
+ *        此后每次发送只需填写长度、标识并计算数据的校验和；路由、邻居或路径mtu改变后模板自动重建
+ *
+ * @param port 本地端口号，0为分配临时端口
+ * @param dst_ip 对端ip地址
+ * @param dst_port 对端端口号
+ * @return udp_socket_t* 端口，打开失败为NULL
+ */
+udp_socket_t *udp_connect(uint16_t port, uint8_t *dst_ip, uint16_t dst_port)
+{
+    udp_socket_t *sock = udp_lookup(port, dst_ip, dst_port, 0);
+    if (sock && sock->connected)
+        return sock;
+    sock = udp_socket_ring_init(udp_socket_new(port), 0, UDP_OVERFLOW_DROP_NEW);
+    if (sock == NULL)
+        return NULL;
+    memcpy(sock->peer.ip, dst_ip, NET_IP_LEN);
+    sock->peer.port = dst_port;
+    sock->connected = 1;
+    udp_peer_resolve(sock);
+    return sock;
+}
+
+/**
+ * @brief 按已连接端口的首部模板发出一个数据报
+ *
+ * @param sock 已连接的端口
+ * @param buf 要发送的数据
+ * @return int 成功为0，无路由或数据超过udp_mtu为-1
+ */
+static int udp_sock_xmit(udp_socket_t *sock, buf_t *buf)
+{
+    udp_peer_t *peer = &sock->peer;
+    if (!peer->resolved || !ip_path_valid(&peer->path))
+        udp_peer_resolve(sock);
+    // 邻居未解析或需要分片时走udp_out的完整路径
+    if (!peer->resolved || buf->len + sizeof(ip_hdr_t) + sizeof(udp_hdr_t) > peer->path.mtu)
+        return udp_out(buf, sock->port, peer->ip, peer->port);
+
+    uint16_t udp_len = buf->len + sizeof(udp_hdr_t);
+    uint16_t id = ip_next_id();
+    // 长度在伪首部与udp首部中各出现一次
+    uint32_t sum = checksum32_add(peer->pseudo_sum + 2 * udp_len, buf->data, buf->len);
+    buf_add_header(buf, UDP_TX_HDR_LEN);
+    memcpy(buf->data, peer->hdr, UDP_TX_HDR_LEN);
+    ip_hdr_t *ip_hdr = (ip_hdr_t *)(buf->data + sizeof(ether_hdr_t));
+    ip_hdr->total_len16 = swap16(udp_len + sizeof(ip_hdr_t));
+    ip_hdr->id16 = swap16(id);
+    ip_hdr->hdr_checksum16 = swap16(checksum32_fold(peer->ip_sum + udp_len + sizeof(ip_hdr_t) + id));
+    udp_hdr_t *udp_header = (udp_hdr_t *)(ip_hdr + 1);
+    udp_header->total_len16 = swap16(udp_len);
+    udp_header->checksum16 = udp_checksum_field(checksum32_fold(sum));
+    ethernet_send(buf, peer->path.netif);
+    return 0;
+}
+
+/**
+ * @brief 向已连接端口的对端发送udp_alloc_tx分配并已填好数据的缓冲区
+ *        端口塞住时数据被追加到待发数据报中，追加后超过路径mtu时先发出已合并的部分
+ *
+ * @param sock 已连接的端口
+ * @param buf udp_alloc_tx返回的缓冲区
+ * @return int 成功为0，端口未连接、无路由或数据超过udp_mtu为-1
+ */
+int udp_sock_commit_tx(udp_socket_t *sock, buf_t *buf)
+{
+    if (!sock->connected)
+        return -1;
+    if (!sock->corked)
+        return udp_sock_xmit(sock, buf);
+    uint16_t limit = udp_mtu(sock->peer.ip);
+    if (limit > UDP_CORK_MAX_LEN)
+        limit = UDP_CORK_MAX_LEN;
+    if (sock->cork_len + buf->len > limit)
+        udp_sock_flush(sock);
+    // 单条数据就装不下时直接发送
+    if (buf->len > limit)
+        return udp_sock_xmit(sock, buf);
+    if (sock->cork_len == 0)
+        udp_corked_num++;
+    memcpy(sock->cork_data + sock->cork_len, buf->data, buf->len);
+    sock->cork_len += buf->len;
+    if (sock->cork_len == limit)
+        udp_sock_flush(sock);
+    return 0;
+}
+
+/**
+ * @brief 发出已连接端口合并的待发数据报
+ *
+ * @param sock 已连接的端口
+ * @return int 成功或没有待发数据为0，失败为-1
+ */
+int udp_sock_flush(udp_socket_t *sock)
+{
+    if (sock->cork_len == 0)
+        return 0;
+    buf_init(&udp_cork_buf, sock->cork_len);
+    memcpy(udp_cork_buf.data, sock->cork_data, sock->cork_len);
+    sock->cork_len = 0;
+    udp_corked_num--;
+    return udp_sock_xmit(sock, &udp_cork_buf);
+}
+
+/**
+ * @brief 塞住或打开已连接的端口
+ *        塞住后连续发送的小数据被合并为一个不超过路径mtu的数据报，减少包数与首部开销，
+ *        数据报在装满、打开端口、调用udp_sock_flush或net_poll结束时发出；对端须能从一个数据报中分出多条消息
+ *
+ * @param sock 已连接的端口
+ * @param enable 1为塞住，0为打开并发出待发数据
+ * @return int 成功为0，端口未连接或发送失败为-1
+ */
+int udp_sock_cork(udp_socket_t *sock, int enable)
+{
+    if (!sock->connected)
+        return -1;
+    sock->corked = enable;
+    return enable ? 0 : udp_sock_flush(sock);
+}
+
+/**
+ * @brief 发出所有塞住端口的待发数据报，由net_poll在每轮结束时调用
+ *
+ */
+void udp_flush_corked()
+{
+    for (size_t i = 0; i < UDP_MAX_SOCKET && udp_corked_num; i++)
+        if (udp_sockets[i].used && udp_sockets[i].cork_len)
+            udp_sock_flush(&udp_sockets[i]);
+}
+
+/**
+ * @brief 向已连接端口的对端发送一个udp包
+ *
+ * @param sock 已连接的端口
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @return int 成功为0，端口未连接、无路由或数据超过udp_mtu为-1
+ */
+int udp_sock_send(udp_socket_t *sock, uint8_t *data, uint16_t len)
+{
+    buf_t *buf = udp_alloc_tx(len);
+    if (buf == NULL)
+        return -1;
+    memcpy(buf->data, data, len);
+    return udp_sock_commit_tx(sock, buf);
+}
+
+/**
+ * @brief 发送由多个分散数据段组成的udp包
+ *        各段直接复制到帧中数据报的位置，复制的同时累加校验和，应用无需先拼接，
+ *        从奇数偏移开始的段的部分和按字节交换后累加
+ *
+ * @param iov 数据段数组
+ * @param iovcnt 数据段数
+ * @param src_port 源端口号
+ * @param dst_ip 目的ip地址
+ * @param dst_port 目的端口号
+ * @return int 成功为0，无路由或数据超过udp_mtu为-1
  */
-void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+int udp_sendv(const struct iovec *iov, int iovcnt, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
 {
-    buf_init(&txbuf, len);
-    memcpy(txbuf.data, data, len);
-    udp_out(&txbuf, src_port, dst_ip, dst_port);
-}
\ No newline at end of file
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; i++)
+        len += iov[i].iov_len;
+    uint8_t *src_ip = ip_src_addr(dst_ip);
+    if (src_ip == NULL || len > UINT16_MAX - sizeof(udp_hdr_t) || udp_alloc_tx(len) == NULL)
+        return -1;
+    uint32_t sum = 0;
+    size_t offset = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        memcpy(txbuf.data + offset, iov[i].iov_base, iov[i].iov_len);
+        uint32_t part = checksum32_add(0, iov[i].iov_base, iov[i].iov_len);
+        if (offset & 1)
+        {
+            while (part >> 16)
+                part = (part >> 16) + (part & 0xffff);
+            part = swap16(part);
+        }
+        sum += part;
+        offset += iov[i].iov_len;
+    }
+    buf_add_header(&txbuf, sizeof(udp_hdr_t));
+    udp_hdr_t *udp_header = (udp_hdr_t *)txbuf.data;
+    udp_header->src_port16 = swap16(src_port);
+    udp_header->dst_port16 = swap16(dst_port);
+    udp_header->total_len16 = swap16(txbuf.len);
+    udp_header->checksum16 = 0;
+    // 伪首部与udp首部，长度在两者中各出现一次
+    sum = checksum32_add(sum, src_ip, NET_IP_LEN);
+    sum = checksum32_add(sum, dst_ip, NET_IP_LEN);
+    sum += NET_PROTOCOL_UDP + src_port + dst_port + 2 * txbuf.len;
+    udp_header->checksum16 = udp_checksum_field(checksum32_fold(sum));
+    return udp_ip_out(&txbuf, dst_ip);
+}
+
+/**
+ * @brief 批量发送udp包
+ *        连续发往同一目的地址与端口的数据报只查找一次路由与arp，ip首部按模板填写，
+ *        整批在一次批量发送中交给网卡；下一跳未解析时只有一个数据报能在arp缓存中等待，其余的不发送也不计数
+ *
+ * @param msgs 数据报数组，每项为要发送的数据与目的地址
+ * @param n 数组长度
+ * @param src_port 源端口号
+ * @return int 成功发送或在arp缓存中等待的数据报数
+ */
+int udp_send_batch(udp_msg_t *msgs, int n, uint16_t src_port)
+{
+    ip_tx_path_t path;
+    udp_msg_t *path_msg = NULL; // 当前路径对应的数据报
+    int resolved = -1;          // 当前路径的解析结果
+    int sent = 0;
+    driver_tx_begin();
+    for (int i = 0; i < n; i++)
+    {
+        udp_msg_t *msg = &msgs[i];
+        if (path_msg == NULL || path_msg->port != msg->port || memcmp(path_msg->ip, msg->ip, NET_IP_LEN))
+        {
+            resolved = ip_path_resolve(&path, msg->ip, NET_PROTOCOL_UDP, src_port, msg->port, UDP_DONT_FRAGMENT);
+            path_msg = msg;
+        }
+        // 已有数据报在arp缓存中等待同一下一跳，arp_out只缓存一个，再发送会被丢弃
+        if (resolved == 2)
+            continue;
+        // 下一跳未解析或需要分片的数据报走udp_send的完整路径，未解析时发出的数据报在arp缓存中等待
+        if (resolved != 0 || msg->len + sizeof(ip_hdr_t) + sizeof(udp_hdr_t) > path.mtu)
+        {
+            if (udp_send(msg->data, msg->len, src_port, msg->ip, msg->port) == 0)
+                sent++;
+            if (resolved == 1)
+                resolved = 2;
+            continue;
+        }
+        if (udp_alloc_tx(msg->len) == NULL)
+            continue;
+        memcpy(txbuf.data, msg->data, msg->len);
+        buf_add_header(&txbuf, sizeof(udp_hdr_t));
+        udp_hdr_t *udp_header = (udp_hdr_t *)txbuf.data;
+        udp_header->src_port16 = swap16(src_port);
+        udp_header->dst_port16 = swap16(msg->port);
+        udp_header->total_len16 = swap16(txbuf.len);
+        udp_header->checksum16 = 0;
+        udp_header->checksum16 = udp_checksum_field(udp_checksum(&txbuf, path.hdr.src_ip, msg->ip));
+        ip_path_out(&path, &txbuf);
+        sent++;
+    }
+    driver_tx_flush();
+    return sent;
+}
+
+/**
+ * @brief 分段发送大块udp数据
+ *        数据按segment_size切分为多个数据报，最后一个可以较短，路由与arp只查找一次，
+ *        伪首部与端口的部分和只计算一次，各段复制时累加自身的校验和，整批在一次批量发送中交给网卡
+ *
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @param segment_size 每个数据报的数据长度，0为不分片时的最大值
+ * @param src_port 源端口号
+ * @param dst_ip 目的ip地址
+ * @param dst_port 目的端口号
+ * @return int 成功发送的数据报数，无路由、分段超过路径mtu或段数超过UDP_GSO_MAX_SEGS为-1；
+ *             下一跳未解析时只有第一段能在arp缓存中等待，返回1，已有数据包在等待时返回0，其余段须由调用者重发
+ */
+int udp_send_gso(uint8_t *data, size_t len, uint16_t segment_size, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+{
+    ip_tx_path_t path;
+    int resolved = ip_path_resolve(&path, dst_ip, NET_PROTOCOL_UDP, src_port, dst_port, UDP_DONT_FRAGMENT);
+    if (resolved < 0)
+        return -1;
+    size_t max_size = path.mtu - sizeof(ip_hdr_t) - sizeof(udp_hdr_t);
+    if (segment_size == 0)
+        segment_size = max_size;
+    if (segment_size > max_size || (len + segment_size - 1) / segment_size > UDP_GSO_MAX_SEGS)
+        return -1;
+    // 伪首部与端口的部分和，各段只需再加上长度与数据
+    uint32_t hdr_sum = checksum32_add(0, path.hdr.src_ip, NET_IP_LEN);
+    hdr_sum = checksum32_add(hdr_sum, dst_ip, NET_IP_LEN);
+    hdr_sum += NET_PROTOCOL_UDP + src_port + dst_port;
+    // arp_out对每个下一跳只缓存一个数据包，未解析时只发出第一段，由其触发arp请求并在arp缓存中等待
+    if (resolved == 2)
+        return 0;
+    if (resolved == 1)
+        return udp_send(data, len < segment_size ? len : segment_size, src_port, dst_ip, dst_port) == 0 ? 1 : 0;
+    int sent = 0;
+    driver_tx_begin();
+    for (size_t offset = 0; offset < len; offset += segment_size)
+    {
+        uint16_t seg_len = len - offset < segment_size ? len - offset : segment_size;
+        if (udp_alloc_tx(seg_len) == NULL)
+            break;
+        memcpy(txbuf.data, data + offset, seg_len);
+        buf_add_header(&txbuf, sizeof(udp_hdr_t));
+        udp_hdr_t *udp_header = (udp_hdr_t *)txbuf.data;
+        udp_header->src_port16 = swap16(src_port);
+        udp_header->dst_port16 = swap16(dst_port);
+        udp_header->total_len16 = swap16(txbuf.len);
+        // 长度在伪首部与udp首部中各出现一次
+        udp_header->checksum16 = udp_checksum_field(checksum32_fold(checksum32_add(hdr_sum + 2 * txbuf.len, data + offset, seg_len)));
+        ip_path_out(&path, &txbuf);
+        sent++;
+    }
+    driver_tx_flush();
+    return sent;
+}
@@ -0,0 +1,206 @@
+#include "udplite.h"
+#include "ip.h"
+#include "icmp.h"
+
+/**
+ * @brief 打开的udp-lite端口
+ *
+ */
+static NET_TLS udplite_socket_t udplite_sockets[UDPLITE_MAX_SOCKET];
+
+/**
+ * @brief 查找打开的udp-lite端口
+ *
+ * @param port 端口号
+ * @return udplite_socket_t* 端口，未打开为NULL
+ */
+static udplite_socket_t *udplite_find(uint16_t port)
+{
+    for (size_t i = 0; i < UDPLITE_MAX_SOCKET; i++)
+        if (udplite_sockets[i].used && udplite_sockets[i].port == port)
+            return &udplite_sockets[i];
+    return NULL;
+}
+
+/**
+ * @brief udp-lite校验和计算，只累加伪首部与前coverage字节
+ *
+ * @param buf 要计算的包，data指向udp-lite首部，校验和字段须为0
+ * @param src_ip 源ip地址
+ * @param dst_ip 目的ip地址
+ * @param coverage 覆盖长度，含首部，不超过数据报长度
+ * @return uint16_t 校验和，主机字节序，计算结果为0时取0xFFFF
+ */
+static uint16_t udplite_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip, uint16_t coverage)
+{
+    // 伪首部中的长度为整个数据报的长度，而不是覆盖长度
+    uint32_t sum = checksum32_add(0, src_ip, NET_IP_LEN);
+    sum = checksum32_add(sum, dst_ip, NET_IP_LEN);
+    sum += NET_PROTOCOL_UDPLITE + buf->len;
+    uint16_t checksum = checksum32_fold(checksum32_add(sum, buf->data, coverage));
+    return checksum ? checksum : 0xFFFF;
+}
+
+/**
+ * @brief 处理一个收到的udp-lite数据包
+ *
+ * @param buf 要处理的包
+ * @param src_ip 源ip地址
+ * @param netif 收到数据包的网卡
+ */
+void udplite_in(buf_t *buf, uint8_t *src_ip, net_if_t *netif)
+{
+    if (buf->len < sizeof(udplite_hdr_t))
+        return;
+    udplite_hdr_t *hdr = (udplite_hdr_t *)buf->data;
+    // 覆盖长度为0表示全部，否则至少覆盖首部且不超过数据报
+    uint16_t coverage = swap16(hdr->coverage16);
+    if (coverage == 0)
+        coverage = buf->len;
+    if (coverage < sizeof(udplite_hdr_t) || coverage > buf->len || hdr->checksum16 == 0)
+        return;
+    uint16_t pre_checksum = hdr->checksum16;
+    hdr->checksum16 = 0;
+    uint16_t now_checksum = udplite_checksum(buf, src_ip, buf->meta.dst_ip, coverage);
+    hdr->checksum16 = pre_checksum;
+    if (swap16(now_checksum) != pre_checksum)
+        return;
+
+    uint16_t dst_port = swap16(hdr->dst_port16);
+    uint16_t src_port = swap16(hdr->src_port16);
+    buf->meta.l4_off = buf->data - buf->payload;
+    buf->meta.src_port = src_port;
+    buf->meta.dst_port = dst_port;
+    udplite_socket_t *sock = udplite_find(dst_port);
+    if (sock == NULL)
+    {
+        buf_add_header(buf, buf->data - (buf->payload + buf->meta.l3_off));
+        icmp_unreachable(buf, src_ip, ICMP_CODE_PORT_UNREACH);
+        return;
+    }
+    // 覆盖范围小于端口要求的数据报被丢弃
+    if (coverage < (sock->recv_coverage ? sock->recv_coverage : buf->len))
+        return;
+    buf_remove_header(buf, sizeof(udplite_hdr_t));
+    sock->handler(buf->data, buf->len, src_ip, src_port);
+}
+
+/**
+ * @brief 处理一个要发送的udp-lite数据包
+ *
+ * @param buf 要处理的包
+ * @param src_port 源端口号
+ * @param dst_ip 目的ip地址
+ * @param dst_port 目的端口号
+ * @param coverage 校验和覆盖长度，含首部，0或超过数据报长度为覆盖全部
+ * @return int 成功为0，无路由或超过路径mtu为-1
+ */
+int udplite_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port, uint16_t coverage)
+{
+    buf_add_header(buf, sizeof(udplite_hdr_t));
+    udplite_hdr_t *hdr = (udplite_hdr_t *)buf->data;
+    hdr->src_port16 = swap16(src_port);
+    hdr->dst_port16 = swap16(dst_port);
+    if (coverage == 0 || coverage >= buf->len)
+    {
+        hdr->coverage16 = 0;
+        coverage = buf->len;
+    }
+    else
+        hdr->coverage16 = swap16(coverage);
+    hdr->checksum16 = 0;
+    uint8_t *src_ip = ip_src_addr(dst_ip);
+    if (src_ip == NULL)
+        return -1;
+    hdr->checksum16 = swap16(udplite_checksum(buf, src_ip, dst_ip, coverage));
+#if UDP_DONT_FRAGMENT
+    return ip_out_df(buf, dst_ip, NET_PROTOCOL_UDPLITE);
+#else
+    ip_out(buf, dst_ip, NET_PROTOCOL_UDPLITE);
+    return 0;
+#endif
+}
+
+/**
+ * @brief 初始化udp-lite协议
+ *
+ */
+void udplite_init()
+{
+    memset(udplite_sockets, 0, sizeof(udplite_sockets));
+    net_add_protocol(NET_PROTOCOL_UDPLITE, udplite_in);
+}
+
+/**
+ * @brief 打开一个udp-lite端口并注册处理程序，默认校验和覆盖整个数据报
+ *
+ * @param port 端口号
+ * @param handler 处理程序
+ * @return int 成功为0，表满为-1
+ */
+int udplite_open(uint16_t port, udp_handler_t handler)
+{
+    udplite_socket_t *sock = udplite_find(port);
+    for (size_t i = 0; i < UDPLITE_MAX_SOCKET && !sock; i++)
+        if (!udplite_sockets[i].used)
+            sock = &udplite_sockets[i];
+    if (sock == NULL)
+        return -1;
+    memset(sock, 0, sizeof(udplite_socket_t));
+    sock->port = port;
+    sock->handler = handler;
+    sock->used = 1;
+    return 0;
+}
+
+/**
+ * @brief 关闭一个udp-lite端口
+ *
+ * @param port 端口号
+ */
+void udplite_close(uint16_t port)
+{
+    udplite_socket_t *sock = udplite_find(port);
+    if (sock)
+        sock->used = 0;
+}
+
+/**
+ * @brief 设置udp-lite端口的校验和覆盖长度
+ *        媒体类数据只需保护首部时，覆盖长度取首部加应用头部的长度，收发时只对这部分计算校验和
+ *
+ * @param port 端口号
+ * @param send_coverage 发送时的覆盖长度，含8字节首部，0为全部
+ * @param recv_coverage 接收时要求的最小覆盖长度，含8字节首部，0为要求全部
+ * @return int 成功为0，端口未打开或长度小于首部为-1
+ */
+int udplite_set_coverage(uint16_t port, uint16_t send_coverage, uint16_t recv_coverage)
+{
+    udplite_socket_t *sock = udplite_find(port);
+    if (sock == NULL ||
+        (send_coverage && send_coverage < sizeof(udplite_hdr_t)) ||
+        (recv_coverage && recv_coverage < sizeof(udplite_hdr_t)))
+        return -1;
+    sock->send_coverage = send_coverage;
+    sock->recv_coverage = recv_coverage;
+    return 0;
+}
+
+/**
+ * @brief 发送一个udp-lite包，覆盖长度取源端口的设置
+ *
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @param src_port 源端口号
+ * @param dst_ip 目的ip地址
+ * @param dst_port 目的端口号
+ * @return int 成功为0，无路由或超过路径mtu为-1
+ */
+int udplite_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+{
+    udplite_socket_t *sock = udplite_find(src_port);
+    if (buf_init(&txbuf, len) < 0)
+        return -1;
+    memcpy(txbuf.data, data, len);
+    return udplite_out(&txbuf, src_port, dst_ip, dst_port, sock ? sock->send_coverage : 0);
+}
@@ -1,6 +1,10 @@
 #include "utils.h"
+#include "config.h"
 #include <stdio.h>
 #include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
 /**
  * @brief ip转字符串
  *
@@ -9,7 +13,7 @@
  */
 char *iptos(uint8_t *ip)
 {
-    static char output[3 * 4 + 3 + 1];
+    static NET_TLS char output[3 * 4 + 3 + 1];
     sprintf(output, "%d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
     return output;
 }
@@ -22,7 +26,7 @@ char *iptos(uint8_t *ip)
  */
 char *mactos(uint8_t *mac)
 {
-    static char output[2 * 6 + 5 + 1];
+    static NET_TLS char output[2 * 6 + 5 + 1];
     sprintf(output, "%02X-%02X-%02X-%02X-%02X-%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
     return output;
 }
@@ -35,7 +39,7 @@ char *mactos(uint8_t *mac)
  */
 char *timetos(time_t timestamp)
 {
-    static char output[20];
+    static NET_TLS char output[20];
     struct tm *utc_time = gmtime(&timestamp);
     sprintf(output, "%04d-%02d-%02d %02d:%02d:%02d", utc_time->tm_year + 1900, utc_time->tm_mon + 1, utc_time->tm_mday, utc_time->tm_hour, utc_time->tm_min, utc_time->tm_sec);
     return output;
@@ -65,6 +69,40 @@ uint8_t ip_prefix_match(uint8_t *ipa, uint8_t *ipb)
     return count;
 }
 
+/**
+ * @brief 计算流的五元组哈希，结果只取决于五元组，同一流总是得到相同的值
+ *
+ * @param src_ip 源ip地址
+ * @param dst_ip 目的ip地址
+ * @param protocol 上层协议
+ * @param src_port 源端口，无端口的协议为0
+ * @param dst_port 目的端口，无端口的协议为0
+ * @return uint32_t 哈希值
+ */
+uint32_t flow_hash(const uint8_t *src_ip, const uint8_t *dst_ip, uint8_t protocol, uint16_t src_port, uint16_t dst_port)
+{
+    uint32_t words[3] = {
+        ((uint32_t)src_ip[0] << 24) | (src_ip[1] << 16) | (src_ip[2] << 8) | src_ip[3],
+        ((uint32_t)dst_ip[0] << 24) | (dst_ip[1] << 16) | (dst_ip[2] << 8) | dst_ip[3],
+        ((uint32_t)src_port << 16) | dst_port,
+    };
+    uint32_t hash = protocol;
+    for (size_t i = 0; i < 3; i++)
+    {
+        uint32_t k = words[i] * 0xcc9e2d51;
+        k = (k << 15) | (k >> 17);
+        hash ^= k * 0x1b873593;
+        hash = ((hash << 13) | (hash >> 19)) * 5 + 0xe6546b64;
+    }
+    // murmur3的最终混合，使低位也充分依赖每个输入位
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
 /**
  * @brief 计算16位校验和
  *
@@ -96,4 +134,105 @@ uint16_t checksum16(uint16_t *data, size_t len)
     }
     checksum += (checksum >> 16);
     return ~(uint16_t)checksum;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 累加校验和的部分和，不折叠也不取反，可分段计算后用checksum32_fold得到校验和
+ *        各段除最后一段外长度须为偶数
+ *
+ * @param sum 已有的部分和，首段为0
+ * @param data 要累加的数据
+ * @param len 数据长度
+ * @return uint32_t 新的部分和
+ */
+uint32_t checksum32_add(uint32_t sum, const uint8_t *data, size_t len)
+{
+    for (; len > 1; len -= 2, data += 2)
+        sum += (data[0] << 8) | data[1];
+    if (len)
+        sum += data[0] << 8;
+    return sum;
+}
+
+/**
+ * @brief 折叠checksum32_add的部分和并取反，得到与checksum16相同的主机字节序校验和
+ *
+ * @param sum 部分和
+ * @return uint16_t 校验和
+ */
+uint16_t checksum32_fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum >> 16) + (sum & 0xffff);
+    return ~(uint16_t)sum;
+}
+
+/**
+ * @brief 按RFC 1624增量更新16位校验和，只修改了个别字段时无需重新计算整个首部
+ *
+ * @param checksum 原校验和，主机序
+ * @param old_word 被修改的16位字的原值，主机序
+ * @param new_word 被修改的16位字的新值，主机序
+ * @return uint16_t 新校验和，主机序
+ */
+uint16_t checksum16_update(uint16_t checksum, uint16_t old_word, uint16_t new_word)
+{
+    uint32_t sum = (uint16_t)~checksum + (uint16_t)~old_word + (uint32_t)new_word;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return ~(uint16_t)sum;
+}
+
+/**
+ * @brief 获取单调时钟的当前时间，用于亚秒级的计时，不受系统时间调整影响
+ *
+ * @return uint64_t 微秒数
+ */
+uint64_t time_us()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return now.QuadPart / freq.QuadPart * 1000000 + now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/**
+ * @brief 初始化令牌桶，初始时桶是满的
+ *
+ * @param bucket 要初始化的令牌桶
+ * @param rate 每秒生成的令牌数，0为不限速
+ * @param burst 桶容量，即允许的最大突发数
+ */
+void token_bucket_init(token_bucket_t *bucket, uint32_t rate, uint32_t burst)
+{
+    bucket->interval_us = rate ? 1000000 / rate : 0;
+    bucket->tolerance_us = bucket->interval_us * (burst ? burst - 1 : 0);
+    bucket->tat_us = 0;
+}
+
+/**
+ * @brief 从令牌桶取一个令牌
+ * 按GCRA实现：只记录下一个令牌的理论到达时间，不需要按时间逐个补充令牌
+ *
+ * @param bucket 令牌桶
+ * @param now_us 当前时间，由time_us得到
+ * @return int 取到为1，桶空为0
+ */
+int token_bucket_take(token_bucket_t *bucket, uint64_t now_us)
+{
+    if (bucket->interval_us == 0)
+        return 1;
+    uint64_t tat = bucket->tat_us > now_us ? bucket->tat_us : now_us;
+    if (tat - now_us > bucket->tolerance_us)
+        return 0;
+    bucket->tat_us = tat + bucket->interval_us;
+    return 1;
+}
@@ -0,0 +1,182 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "worker.h"
+#include "driver.h"
+
+#ifdef NET_STACK_PER_THREAD
+
+typedef enum worker_state
+{
+    WORKER_STARTING, // 正在初始化协议栈
+    WORKER_RUNNING,  // 正在轮询
+    WORKER_FAILED,   // 初始化失败，线程已退出
+} worker_state_t;
+
+/**
+ * @brief 工作线程，每个线程运行一个只接收一个分片的协议栈实例
+ *
+ */
+static struct
+{
+    pthread_t thread;
+    int index;
+    int state;
+} workers[WORKER_MAX_NUM];
+static int workers_num;
+static int workers_running;
+static worker_setup_t workers_setup;
+
+/**
+ * @brief 把当前线程绑定到一个核上，失败时线程仍可运行，只是不再固定在该核上
+ *
+ * @param core 核号，须小于在线的核数
+ * @return int 成功为0，失败为-1
+ */
+int worker_pin(int core)
+{
+#if defined(__linux__)
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (core < 0 || core >= online || core >= CPU_SETSIZE)
+    {
+        fprintf(stderr, "Error in worker_pin: core %d is not online, %ld cores online.\n", core, online);
+        return -1;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err)
+    {
+        fprintf(stderr, "Error in worker_pin: pthread_setaffinity_np on core %d. %s.\n", core, strerror(err));
+        return -1;
+    }
+#elif defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    if (core < 0 || (DWORD)core >= info.dwNumberOfProcessors || core >= (int)(sizeof(DWORD_PTR) * 8))
+    {
+        fprintf(stderr, "Error in worker_pin: core %d is not online, %lu cores online.\n", core, (unsigned long)info.dwNumberOfProcessors);
+        return -1;
+    }
+    if (SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) == 0)
+    {
+        fprintf(stderr, "Error in worker_pin: SetThreadAffinityMask on core %d, error %lu.\n", core, (unsigned long)GetLastError());
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+/**
+ * @brief 内部函数，工作线程的入口，初始化本线程的协议栈实例后循环轮询，直到worker_stop
+ *
+ * @param arg 工作线程
+ * @return void* NULL
+ */
+static void *worker_main(void *arg)
+{
+    int index = *(int *)arg;
+    worker_pin(index);
+    driver_set_shard(index, workers_num);
+    if (net_init() == -1)
+    {
+        // net_init可能在打开部分网卡后失败，关闭已打开的
+        for (size_t i = 0; i < net_if_num; i++)
+            if (NET_IF_STATE(&net_if_table[i])->driver)
+                driver_close(&net_if_table[i]);
+        __atomic_store_n(&workers[index].state, WORKER_FAILED, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    if (workers_setup)
+        workers_setup(index);
+    __atomic_store_n(&workers[index].state, WORKER_RUNNING, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&workers_running, __ATOMIC_ACQUIRE))
+        net_poll();
+    for (size_t i = 0; i < net_if_num; i++)
+        driver_close(&net_if_table[i]);
+    return NULL;
+}
+
+/**
+ * @brief 启动按核分片运行的工作线程
+ *        第i个线程绑定到核i，用只接收第i个分片的过滤条件打开网卡，在自己的协议栈实例中完成收包、处理与发送，
+ *        各实例只共用网卡表、路由表与arp表，吞吐随核数近似线性增长
+ *        共用的表在启动线程前建立，线程逐个启动，前一个初始化完成后再启动下一个，某个线程失败时停止已启动的线程
+ *
+ * @param num 线程数，不超过WORKER_MAX_NUM
+ * @param setup 每个线程初始化协议栈后调用的程序，可为NULL
+ * @return int 成功为0，失败为-1，此时已启动的线程被停止
+ */
+int worker_start(int num, worker_setup_t setup)
+{
+    if (num < 1 || num > WORKER_MAX_NUM || workers_num)
+        return -1;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    // 协议栈实例位于线程局部存储，默认的栈容纳不下
+    pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+    net_shared_init();
+    workers_num = num;
+    workers_setup = setup;
+    __atomic_store_n(&workers_running, 1, __ATOMIC_RELEASE);
+    int started = 0;
+    for (; started < num; started++)
+    {
+        workers[started].index = started;
+        workers[started].state = WORKER_STARTING;
+        if (pthread_create(&workers[started].thread, &attr, worker_main, &workers[started].index))
+            break;
+        int state;
+        while ((state = __atomic_load_n(&workers[started].state, __ATOMIC_ACQUIRE)) == WORKER_STARTING)
+            sched_yield();
+        if (state == WORKER_FAILED)
+        {
+            pthread_join(workers[started].thread, NULL);
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    if (started < num)
+    {
+        fprintf(stderr, "Error in worker_start: worker %d failed.\n", started);
+        workers_num = started;
+        worker_stop();
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 停止全部工作线程并等待其关闭网卡后退出
+ *
+ */
+void worker_stop()
+{
+    __atomic_store_n(&workers_running, 0, __ATOMIC_RELEASE);
+    for (int i = 0; i < workers_num; i++)
+        pthread_join(workers[i].thread, NULL);
+    workers_num = 0;
+}
+
+/**
+ * @brief 获取正在运行的工作线程数
+ *
+ * @return int 线程数
+ */
+int worker_num()
+{
+    return workers_num;
+}
+
+#endif
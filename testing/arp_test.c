@@ -17,7 +17,7 @@ extern FILE *arp_log_f;
 char* print_ip(uint8_t *ip);
 char* print_mac(uint8_t *mac);
 
-uint8_t my_mac[] = NET_IF_MAC;
+net_if_t *netif = &net_if_table[0];
 uint8_t boardcast_mac[] = {0xff,0xff,0xff,0xff,0xff,0xff};
 
 int check_log();
@@ -47,26 +47,26 @@ int main(int argc, char* argv[]){
         log_tab_buf();
         int i = 1;
         printf("\e[0;34mFeeding input %02d",i);
-        while((ret = driver_recv(&buf)) > 0){
+        while((ret = driver_recv(&buf, netif)) > 0){
                 printf("\b\b%02d",i);
                 fprintf(control_flow,"\nRound %02d -----------------------------\n",i++);
-                if(memcmp(buf.data,my_mac,6) && memcmp(buf.data,boardcast_mac,6)){
+                if(memcmp(buf.data,netif->mac,6) && memcmp(buf.data,boardcast_mac,6)){
                         buf_t buf2;
                         buf_copy(&buf2, &buf, 0);
                         memset(buf2.data,0,sizeof(ether_hdr_t));
                         buf_remove_header(&buf2, sizeof(ether_hdr_t));
                         uint8_t * ip = buf.data + 30;
                         // net_protocol_t pro = buf.data[13] ? NET_PROTOCOL_ARP : NET_PROTOCOL_IP;
-                        arp_out(&buf2, ip);
+                        arp_out(&buf2, ip, netif);
                 }else{
-                        ethernet_in(&buf);
+                        ethernet_in(&buf, netif);
                 }
                 log_tab_buf();
         }
         if(ret < 0){
                 fprintf(stderr,"\e[1;31m\nError occur on receive,exiting\n");
         }
-        driver_close();
+        driver_close(netif);
         printf("\e[0;34m\nSample input all processed, checking output\n");
 
         fclose(control_flow);
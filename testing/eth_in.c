@@ -13,6 +13,7 @@ extern FILE *out_log;
 int check_log();
 FILE* open_file(char * path, char * name, char * mode);
 
+net_if_t *netif = &net_if_table[0];
 buf_t buf;
 int main(int argc, char* argv[]){
         int ret;
@@ -33,15 +34,15 @@ int main(int argc, char* argv[]){
         net_init();
         int i = 1;
         printf("\e[0;34mFeeding input %02d",i);
-        while((ret = driver_recv(&buf)) > 0){
+        while((ret = driver_recv(&buf, netif)) > 0){
                 printf("\b\b%02d",i);
                 fprintf(control_flow,"\nRound %02d -----------------------------\n",i++);
-                ethernet_in(&buf);
+                ethernet_in(&buf, netif);
         }
         if(ret < 0){
                 fprintf(stderr,"\e[1;31m\nError occur on loading input,exiting\n");
         }
-        driver_close();
+        driver_close(netif);
         printf("\e[0;34m\nSample input all processed, checking output\n");
 
         fclose(ip_fout);
@@ -12,7 +12,8 @@ char* print_mac(uint8_t *mac);
 void fprint_buf(FILE* f, buf_t* buf);
 
 map_t arp_table;
-map_t arp_buf;
+uint32_t arp_generation;
+NET_TLS map_t arp_buf;
 
 // void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state)
 // {
@@ -22,23 +23,41 @@ map_t arp_buf;
 //         fprintf(arp_fout,"state:%d\n",state);
 // }
 
-void arp_in(buf_t *buf, uint8_t *src_mac)
+void arp_in(buf_t *buf, uint8_t *src_mac, net_if_t *netif)
 {
         fprintf(arp_fout,"arp_in:\n");
         fprintf(arp_fout,"\tmac:%s\n", print_mac(src_mac));
         fprint_buf(arp_fout,buf);
 }
 
-void arp_out(buf_t *buf, uint8_t *ip)
+void arp_out(buf_t *buf, uint8_t *ip, net_if_t *netif)
 {
         fprintf(arp_fout,"arp_out:\n");
         fprintf(arp_fout,"\tip:%s\n",print_ip(ip));
         fprint_buf(arp_fout,buf);
 }
 
+void arp_table_init()
+{
+}
+
 void arp_init()
 {
     map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
     map_init(&arp_buf, NET_IP_LEN, sizeof(buf_t), 0, ARP_MIN_INTERVAL, buf_copy);
     net_add_protocol(NET_PROTOCOL_ARP, arp_in);
-}
\ No newline at end of file
+}
+
+int arp_lookup(uint8_t *ip, uint8_t *mac)
+{
+        return -1;
+}
+
+int arp_pending(uint8_t *ip)
+{
+        return 0;
+}
+
+void arp_poll()
+{
+}
@@ -3,6 +3,7 @@
 #include <utils.h>
 #include "config.h"
 #include "buf.h"
+#include "net.h"
 
 static pcap_t *pcap;
 static pcap_dumper_t *pdump;
@@ -33,7 +34,7 @@ BOOL LoadNpcapDlls()
 }
 #endif
 
-int driver_open()
+int driver_open(net_if_t *netif)
 {
 #ifdef _WIN32
         /* Load Npcap and its functions. */
@@ -55,11 +56,12 @@ int driver_open()
                 return -1;
         }
 
+        NET_IF_STATE(netif)->driver = pcap;
         fprintf(control_flow,"driver opened\n");
         return 0;
 }
 
-int driver_recv(buf_t *buf)
+int driver_recv(buf_t *buf, net_if_t *netif)
 {
         struct pcap_pkthdr *pkt_hdr;
         const uint8_t *pkt_data;
@@ -77,7 +79,7 @@ int driver_recv(buf_t *buf)
         }
 }
 
-int driver_send(buf_t *buf)
+int driver_send(buf_t *buf, net_if_t *netif)
 {
         struct pcap_pkthdr header;
         memset(&header.ts,0,sizeof(header.ts));
@@ -87,7 +89,16 @@ int driver_send(buf_t *buf)
         return 0;
 }
 
-void driver_close()
+void driver_tx_begin()
+{
+}
+
+int driver_tx_flush()
+{
+        return 0;
+}
+
+void driver_close(net_if_t *netif)
 {
         fprintf(control_flow,"\ndriver closed\n");
         pcap_dump_close(pdump);
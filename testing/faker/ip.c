@@ -11,14 +11,14 @@ char* print_ip(uint8_t *ip);
 char* print_mac(uint8_t *mac);
 void fprint_buf(FILE* f, buf_t* buf);
 
-void ip_in(buf_t *buf, uint8_t *src_mac)
+void ip_in(buf_t *buf, uint8_t *src_mac, net_if_t *netif)
 {
         fprintf(ip_fout,"ip_in:\n");
         fprintf(ip_fout,"\tmac:%s\n", print_mac(src_mac));
         fprint_buf(ip_fout, buf);
 }
 
-void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
+void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf, int df, uint8_t *next_hop, net_if_t *netif)
 {
         fprintf(ip_fout,"ip_fragment_out:\n");        
         fprintf(ip_fout,"\tip: %s\n", print_ip(ip));
@@ -37,6 +37,10 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
         fprint_buf(ip_fout, buf);
 }
 
+void ip_route_init()
+{
+}
+
 void ip_init()
 {
     net_add_protocol(NET_PROTOCOL_IP, ip_in);
@@ -8,13 +8,14 @@ extern FILE *udp_fout;
 char* print_ip(uint8_t *ip);
 void fprint_buf(FILE* f, buf_t* buf);
 
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
+int udp_out(buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
 {
         fprintf(udp_fout,"udp_out:\n");
         fprintf(udp_fout,"\tsrc_port: %d\n", src_port);
         fprintf(udp_fout,"\tdest_ip: %s\n", print_ip(dest_ip));
         fprintf(udp_fout,"\tdest_port: %d\n", dest_port);
         fprint_buf(udp_fout, buf);
+        return 0;
 }
 
 void udp_init()
@@ -35,7 +36,7 @@ void udp_close(uint16_t port)
 }
 
 
-void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
+int udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
 {
         fprintf(udp_fout,"udp_send:\n\tlen:%d\n",len);
         fprintf(udp_fout,"\tsrc_port:%d\n",src_port);
@@ -50,10 +51,24 @@ void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip,
         }else{
                 fprintf(udp_fout," (null)\n");
         }
+        return 0;
 }
 
-void udp_in(buf_t *buf, uint8_t *src_ip)
+void udp_in(buf_t *buf, uint8_t *src_ip, net_if_t *netif)
 {
         fprintf(udp_fout,"udp_in:\n\tsrc_ip:%s\n",print_ip(src_ip));
         fprint_buf(udp_fout, buf);
-}
\ No newline at end of file
+}
+void udp_err_in(buf_t *buf, uint8_t code)
+{
+        fprintf(udp_fout,"udp_err_in: code:%d\n",code);
+        fprint_buf(udp_fout, buf);
+}
+
+void udp_flush_corked()
+{
+}
+
+void udp_gro_flush()
+{
+}
@@ -0,0 +1,5 @@
+#include "udplite.h"
+
+void udplite_init()
+{
+}
@@ -30,7 +30,7 @@ FILE *out_log;
 FILE *demo_log;
 
 extern map_t arp_table;
-extern map_t arp_buf;
+extern NET_TLS map_t arp_buf;
 
 // char* state[16] = {
 //         [ARP_PENDING] "pending",
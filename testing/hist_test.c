@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include "hist.h"
+
+/**
+ * 与精确的百分位数比较，对数线性直方图的相对误差不应超过1/HIST_SUB_BUCKET_NUM
+ */
+static int check(hist_t *hist, double percentile, uint64_t expect)
+{
+        uint64_t value = hist_percentile(hist, percentile);
+        double err = expect ? ((double)value - expect) / expect : value;
+        printf("\e[0;34mp%-5g = %-10llu expect %-10llu error %+.2f%%\n\e[0m", percentile,
+               (unsigned long long)value, (unsigned long long)expect, err * 100);
+        if (err < 0 || err > 1.0 / HIST_SUB_BUCKET_NUM) {
+                printf("\e[1;31mp%g is out of range\n\e[0m", percentile);
+                return -1;
+        }
+        return 0;
+}
+
+int main(int argc, char* argv[])
+{
+        static hist_t hist;
+        int ret = 0;
+        printf("\e[0;34mHistogram test.\n\e[0m");
+
+        // 小于子桶数的值是精确的
+        hist_init(&hist);
+        for (uint64_t v = 0; v < HIST_SUB_BUCKET_NUM; v++)
+                hist_record(&hist, v);
+        for (uint64_t v = 0; v < HIST_SUB_BUCKET_NUM; v++)
+                ret |= check(&hist, 100.0 * (v + 1) / HIST_SUB_BUCKET_NUM, v);
+
+        // 1到1000000均匀分布
+        hist_init(&hist);
+        for (uint64_t v = 1; v <= 1000000; v++)
+                hist_record(&hist, v);
+        ret |= check(&hist, 50, 500000);
+        ret |= check(&hist, 99, 990000);
+        ret |= check(&hist, 99.9, 999000);
+        ret |= check(&hist, 100, 1000000);
+
+        // 长尾：绝大多数很小，少数极大
+        hist_init(&hist);
+        for (int i = 0; i < 999; i++)
+                hist_record(&hist, 100);
+        hist_record(&hist, (uint64_t)1 << 40);
+        ret |= check(&hist, 99.9, 100);
+        ret |= check(&hist, 100, (uint64_t)1 << 40);
+        if (hist.min != 100 || hist.max != (uint64_t)1 << 40 || hist.total != 1000) {
+                printf("\e[1;31mmin/max/total mismatch\n\e[0m");
+                ret = -1;
+        }
+
+        if (ret == 0)
+                printf("\e[1;32m====> Histogram percentiles are within the expected error.\n\e[0m");
+        return ret ? -1 : 0;
+}
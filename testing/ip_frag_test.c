@@ -31,7 +31,8 @@ int main(int argc, char* argv[])
                 buf.len++;
         }
         printf("\e[0;34mFeeding input.\n");
-        ip_out(&buf,net_if_ip,NET_PROTOCOL_TCP);
+        ip_init();
+        ip_out(&buf,net_if_table[0].ip[0],NET_PROTOCOL_TCP);
 
         fclose(in);
         fclose(control_flow);
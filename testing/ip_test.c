@@ -18,7 +18,7 @@ extern FILE *arp_log_f;
 char* print_ip(uint8_t *ip);
 char* print_mac(uint8_t *mac);
 
-uint8_t my_mac[] = NET_IF_MAC;
+net_if_t *netif = &net_if_table[0];
 uint8_t boardcast_mac[] = {0xff,0xff,0xff,0xff,0xff,0xff};
 char* state[16];
 
@@ -50,11 +50,11 @@ int main(int argc, char* argv[]){
         log_tab_buf();
         int i = 1;
         printf("\e[0;34mFeeding input %02d",i);
-        while((ret = driver_recv(&buf)) > 0){
+        while((ret = driver_recv(&buf, netif)) > 0){
                 printf("\b\b%02d",i);
                 // printf("\nFeeding input %02d\n",i);
                 fprintf(control_flow,"\nRound %02d -----------------------------\n",i++);
-                if(memcmp(buf.data,my_mac,6) && memcmp(buf.data,boardcast_mac,6)){
+                if(memcmp(buf.data,netif->mac,6) && memcmp(buf.data,boardcast_mac,6)){
                         buf_t buf2;
                         buf_copy(&buf2, &buf, 0);
                         memset(buf2.data,0,sizeof(ether_hdr_t));
@@ -67,14 +67,14 @@ int main(int argc, char* argv[]){
                         // printf("ip_out: hd_len:%d\tip:%s\tpro:%d\n",len,print_ip(ip),pro);
                         ip_out(&buf2,ip,pro);
                 }else{
-                        ethernet_in(&buf);
+                        ethernet_in(&buf, netif);
                 }
                 log_tab_buf();
         }
         if(ret < 0){
                 fprintf(stderr,"\e[1;31m\nError occur on loading input,exiting\n");
         }
-        driver_close();
+        driver_close(netif);
         printf("\e[0;34m\nSample input all processed, checking output\n");
 
         fclose(control_flow);
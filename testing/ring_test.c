@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include "ring.h"
+
+static int push(ring_t *ring, uint32_t value, int overwrite)
+{
+        uint32_t *slot = ring_enqueue_slot(ring);
+        if (slot == NULL && overwrite && ring_drop_oldest(ring) == 0)
+                slot = ring_enqueue_slot(ring);
+        if (slot == NULL)
+                return -1;
+        *slot = value;
+        ring_enqueue_commit(ring);
+        return 0;
+}
+
+static int pop(ring_t *ring, uint32_t *value)
+{
+        uint32_t *slot = ring_dequeue_slot(ring);
+        if (slot == NULL)
+                return -1;
+        *value = *slot;
+        return ring_dequeue_commit(ring);
+}
+
+/**
+ * 按先进先出顺序逐个取出，检查取出的值从first开始连续且恰有num个
+ */
+static int expect_seq(ring_t *ring, uint32_t first, uint32_t num)
+{
+        uint32_t value;
+        for (uint32_t i = 0; i < num; i++)
+                if (pop(ring, &value) < 0 || value != first + i) {
+                        printf("\e[1;31mExpect %u at position %u\n\e[0m", first + i, i);
+                        return -1;
+                }
+        if (pop(ring, &value) == 0) {
+                printf("\e[1;31mRing should be empty\n\e[0m");
+                return -1;
+        }
+        return 0;
+}
+
+int main(int argc, char* argv[])
+{
+        ring_t ring;
+        int ret = 0;
+        printf("\e[0;34mRing test.\n\e[0m");
+
+        // 深度向上取整到2的幂
+        ring_init(&ring, sizeof(uint32_t), 100);
+        if (ring_depth(&ring) != 128) {
+                printf("\e[1;31mDepth %u, expect 128\n\e[0m", ring_depth(&ring));
+                ret = -1;
+        }
+
+        // 满时丢弃新元素
+        for (uint32_t i = 0; i < 200; i++)
+                push(&ring, i, 0);
+        if (ring_count(&ring) != 128) {
+                printf("\e[1;31mCount %u, expect 128\n\e[0m", ring_count(&ring));
+                ret = -1;
+        }
+        ret |= expect_seq(&ring, 0, 128);
+
+        // 满时丢弃最旧元素，保留最新的128个
+        for (uint32_t i = 0; i < 200; i++)
+                push(&ring, i, 1);
+        ret |= expect_seq(&ring, 200 - 128, 128);
+
+        // 下标回绕后仍保持先进先出
+        for (uint32_t round = 0; round < 1000; round++) {
+                for (uint32_t i = 0; i < 7; i++)
+                        push(&ring, round * 7 + i, 0);
+                ret |= expect_seq(&ring, round * 7, 7);
+        }
+
+        // 消费者读取期间元素被生产者丢弃并覆盖时出队失败
+        for (uint32_t i = 0; i < 128; i++)
+                push(&ring, i, 0);
+        ring_dequeue_slot(&ring);
+        push(&ring, 128, 1);
+        if (ring_dequeue_commit(&ring) == 0) {
+                printf("\e[1;31mOverwritten slot was dequeued\n\e[0m");
+                ret = -1;
+        }
+        ret |= expect_seq(&ring, 1, 128);
+        ring_free(&ring);
+
+        if (ret == 0)
+                printf("\e[1;32m====> All ring checks passed.\n\e[0m");
+        return ret ? -1 : 0;
+}
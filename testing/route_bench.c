@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "route.h"
+
+#define LOOKUP_NUM (1 << 20)  //每轮查找的地址数
+#define LOOKUP_ROUND 16       //查找轮数
+#define VERIFY_NUM 2000       //与朴素最长前缀匹配对拍的地址数
+#define CHURN_NUM 100000      //反复增删时保持的路由数
+#define CHURN_ROUND 2000000   //反复增删的次数，分四段计时
+
+typedef struct prefix {
+        uint32_t addr;
+        uint8_t len;
+} prefix_t;
+
+static uint64_t rand_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rand32()
+{
+        rand_state ^= rand_state << 13;
+        rand_state ^= rand_state >> 7;
+        rand_state ^= rand_state << 17;
+        return (uint32_t)(rand_state >> 16);
+}
+
+static void u32_to_ip(uint32_t addr, uint8_t *ip)
+{
+        ip[0] = addr >> 24;
+        ip[1] = addr >> 16;
+        ip[2] = addr >> 8;
+        ip[3] = addr;
+}
+
+/**
+ * 前缀长度的分布近似真实的BGP表：以/24为主，少量短前缀与长于/24的前缀
+ */
+static uint8_t rand_len()
+{
+        uint32_t r = rand32() % 100;
+        if (r < 60) return 24;
+        if (r < 90) return 16 + rand32() % 8;
+        if (r < 98) return 8 + rand32() % 8;
+        return 25 + rand32() % 8;
+}
+
+static int naive_lookup(prefix_t *prefixes, int num, uint32_t addr)
+{
+        int best = -1;
+        for (int i = 0; i < num; i++) {
+                uint32_t mask = ~0u << (32 - prefixes[i].len);
+                if ((addr & mask) == prefixes[i].addr && prefixes[i].len > best)
+                        best = prefixes[i].len;
+        }
+        return best;
+}
+
+static int bench(int num)
+{
+        static uint8_t addrs[LOOKUP_NUM][NET_IP_LEN];
+        prefix_t *prefixes = malloc(num * sizeof(prefix_t));
+        uint8_t ip[NET_IP_LEN], gw[NET_IP_LEN] = {10, 0, 0, 1};
+        int failed = 0;
+
+        route_init();
+        clock_t begin = clock();
+        for (int i = 0; i < num; i++) {
+                prefixes[i].len = rand_len();
+                prefixes[i].addr = rand32() & (~0u << (32 - prefixes[i].len));
+                u32_to_ip(prefixes[i].addr, ip);
+                gw[3] = i;
+                if (route_add(ip, prefixes[i].len, gw, NULL) < 0) {
+                        printf("\e[1;31mroute_add failed at prefix %d\n\e[0m", i);
+                        free(prefixes);
+                        return -1;
+                }
+        }
+        double add_sec = (double)(clock() - begin) / CLOCKS_PER_SEC;
+
+        // 一半地址落在已有前缀内，一半完全随机
+        for (int i = 0; i < LOOKUP_NUM; i++) {
+                uint32_t addr = rand32();
+                if (i & 1) {
+                        prefix_t *p = &prefixes[rand32() % num];
+                        addr = p->addr | (addr & ~(~0u << (32 - p->len)));
+                }
+                u32_to_ip(addr, addrs[i]);
+        }
+
+        for (int i = 0; i < VERIFY_NUM; i++) {
+                uint32_t addr = ((uint32_t)addrs[i][0] << 24) | (addrs[i][1] << 16) | (addrs[i][2] << 8) | addrs[i][3];
+                route_t *route = route_lookup(addrs[i]);
+                int expect = naive_lookup(prefixes, num, addr);
+                if ((route ? route->prefix_len : -1) != expect) {
+                        printf("\e[1;31mMismatch on %s: expect /%d\n\e[0m", iptos(addrs[i]), expect);
+                        failed = 1;
+                        break;
+                }
+        }
+
+        size_t hit = 0;
+        begin = clock();
+        for (int r = 0; r < LOOKUP_ROUND; r++)
+                for (int i = 0; i < LOOKUP_NUM; i++)
+                        hit += route_lookup(addrs[i]) != NULL;
+        double lookup_sec = (double)(clock() - begin) / CLOCKS_PER_SEC;
+        double lookups = (double)LOOKUP_ROUND * LOOKUP_NUM;
+
+        printf("\e[0;34m%7d prefixes (%zu unique): add %.3f s, %.1f Mlookup/s, %.2f ns/lookup, hit %.1f%%\n\e[0m",
+               num, route_size(), add_sec, lookups / lookup_sec / 1e6, lookup_sec * 1e9 / lookups, 100.0 * hit / lookups);
+
+        // 删除全部路由后表应为空
+        for (int i = 0; i < num && !failed; i++) {
+                u32_to_ip(prefixes[i].addr, ip);
+                route_delete(ip, prefixes[i].len);
+        }
+        for (int i = 0; i < VERIFY_NUM && !failed; i++)
+                if (route_lookup(addrs[i])) {
+                        printf("\e[1;31mStale route found on %s after delete\n\e[0m", iptos(addrs[i]));
+                        failed = 1;
+                }
+        free(prefixes);
+        return failed ? -1 : 0;
+}
+
+static uint32_t rand_addr(prefix_t *p)
+{
+        p->len = 20 + rand32() % 5;
+        p->addr = rand32() & (~0u << (32 - p->len));
+        return p->addr;
+}
+
+/**
+ * 反复删除一条旧路由、添加一条新路由，删除不应让之后的增删查越来越慢或出错
+ * 前缀取/20到/24，每次增删只改写少量tbl24表项，耗时主要在哈希索引上
+ */
+static int churn_check()
+{
+        prefix_t *prefixes = malloc(CHURN_NUM * sizeof(prefix_t));
+        uint8_t ip[NET_IP_LEN], gw[NET_IP_LEN] = {10, 0, 0, 1};
+        int failed = 0;
+
+        route_init();
+        for (int i = 0; i < CHURN_NUM; i++) {
+                do {
+                        u32_to_ip(rand_addr(&prefixes[i]), ip);
+                        route_add(ip, prefixes[i].len, gw, NULL);
+                } while (route_size() != (size_t)i + 1);
+        }
+
+        double quarter_sec[4] = {0};
+        clock_t begin = clock();
+        for (int r = 0; r < CHURN_ROUND && !failed; r++) {
+                if (r && r % (CHURN_ROUND / 4) == 0) {
+                        quarter_sec[r / (CHURN_ROUND / 4) - 1] = (double)(clock() - begin) / CLOCKS_PER_SEC;
+                        begin = clock();
+                }
+                prefix_t *p = &prefixes[rand32() % CHURN_NUM];
+                u32_to_ip(p->addr, ip);
+                if (route_delete(ip, p->len) < 0) {
+                        printf("\e[1;31mroute_delete failed at round %d\n\e[0m", r);
+                        failed = 1;
+                }
+                do {
+                        u32_to_ip(rand_addr(p), ip);
+                        route_add(ip, p->len, gw, NULL);
+                } while (route_size() != CHURN_NUM);
+        }
+        quarter_sec[3] = (double)(clock() - begin) / CLOCKS_PER_SEC;
+
+        for (int i = 0; i < VERIFY_NUM && !failed; i++) {
+                uint32_t addr = rand32();
+                if (i & 1) {
+                        prefix_t *p = &prefixes[rand32() % CHURN_NUM];
+                        addr = p->addr | (addr & ~(~0u << (32 - p->len)));
+                }
+                u32_to_ip(addr, ip);
+                route_t *route = route_lookup(ip);
+                int expect = naive_lookup(prefixes, CHURN_NUM, addr);
+                if ((route ? route->prefix_len : -1) != expect) {
+                        printf("\e[1;31mMismatch on %s after churn: expect /%d\n\e[0m", iptos(ip), expect);
+                        failed = 1;
+                }
+        }
+        printf("\e[0;34mChurn %d delete+add over %d prefixes: %.2f us/pair first quarter, %.2f us/pair last quarter\n\e[0m",
+               CHURN_ROUND, CHURN_NUM, quarter_sec[0] * 4e6 / CHURN_ROUND, quarter_sec[3] * 4e6 / CHURN_ROUND);
+        if (!failed && quarter_sec[3] > 3 * quarter_sec[0] + 0.1) {
+                printf("\e[1;31mRoute updates slowed down under churn\n\e[0m");
+                failed = 1;
+        }
+        free(prefixes);
+        return failed ? -1 : 0;
+}
+
+/**
+ * 等价多路径：同一流总是选中同一网关，不同流大致均匀地分摊到各网关
+ */
+static int ecmp_check()
+{
+        uint8_t gws[4][NET_IP_LEN] = {{10, 0, 0, 1}, {10, 0, 0, 2}, {10, 0, 0, 3}, {10, 0, 0, 4}};
+        uint8_t prefix[NET_IP_LEN] = {0}, src[NET_IP_LEN] = {192, 168, 163, 103}, dst[NET_IP_LEN];
+        int count[4] = {0};
+        int flows = 100000;
+
+        route_init();
+        route_add_multipath(prefix, 0, (const uint8_t(*)[NET_IP_LEN])gws, 4, NULL);
+        for (int i = 0; i < flows; i++) {
+                u32_to_ip(rand32(), dst);
+                uint16_t sport = rand32(), dport = rand32();
+                uint8_t *gw = route_next_hop(route_lookup(dst), dst, flow_hash(src, dst, NET_PROTOCOL_UDP, sport, dport));
+                if (gw != route_next_hop(route_lookup(dst), dst, flow_hash(src, dst, NET_PROTOCOL_UDP, sport, dport))) {
+                        printf("\e[1;31mFlow to %s changed its gateway\n\e[0m", iptos(dst));
+                        return -1;
+                }
+                count[gw[3] - 1]++;
+        }
+        printf("\e[0;34mECMP over 4 gateways: %d %d %d %d flows\n\e[0m", count[0], count[1], count[2], count[3]);
+        for (int i = 0; i < 4; i++)
+                if (count[i] < flows / 4 * 9 / 10 || count[i] > flows / 4 * 11 / 10) {
+                        printf("\e[1;31mGateway %d is unbalanced\n\e[0m", i + 1);
+                        return -1;
+                }
+        return 0;
+}
+
+int main(int argc, char* argv[])
+{
+        int ret = 0;
+        printf("\e[0;34mRoute lookup benchmark.\n\e[0m");
+        ret |= bench(1000);
+        ret |= bench(100000);
+        ret |= churn_check();
+        ret |= ecmp_check();
+        if (ret == 0)
+                printf("\e[1;32m====> Route lookups match the naive longest prefix match.\n\e[0m");
+        return ret ? -1 : 0;
+}
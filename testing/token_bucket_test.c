@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include "utils.h"
+
+/**
+ * 在now时刻连续取num个令牌，检查恰好前expect个取到
+ */
+static int expect_take(token_bucket_t *bucket, uint64_t now, int num, int expect, const char *what)
+{
+        int got = 0;
+        for (int i = 0; i < num; i++)
+                if (token_bucket_take(bucket, now)) {
+                        if (got != i) {
+                                printf("\e[1;31m%s: token %d taken after an empty bucket\n\e[0m", what, i);
+                                return -1;
+                        }
+                        got++;
+                }
+        if (got != expect) {
+                printf("\e[1;31m%s: took %d tokens, expect %d\n\e[0m", what, got, expect);
+                return -1;
+        }
+        return 0;
+}
+
+int main(int argc, char* argv[])
+{
+        token_bucket_t bucket;
+        int ret = 0;
+        printf("\e[0;34mToken bucket test.\n\e[0m");
+
+        // 每秒100个，突发10个：初始时桶是满的
+        uint64_t now = 1000000;
+        token_bucket_init(&bucket, 100, 10);
+        ret |= expect_take(&bucket, now, 12, 10, "initial burst");
+
+        // 不到一个间隔时仍取不到，满一个间隔补充一个
+        ret |= expect_take(&bucket, now + 9999, 1, 0, "before one interval");
+        ret |= expect_take(&bucket, now + 10000, 2, 1, "after one interval");
+
+        // 闲置很久也只能攒满一桶，不会超过突发数
+        now += 60 * 1000000ULL;
+        ret |= expect_take(&bucket, now, 20, 10, "after long idle");
+
+        // 按速率均匀到达时每个都能取到
+        for (int i = 1; i <= 1000 && ret == 0; i++)
+                ret |= expect_take(&bucket, now + i * 10000ULL, 1, 1, "steady rate");
+
+        // 突发为1时只能按间隔取
+        token_bucket_init(&bucket, 1000, 1);
+        ret |= expect_take(&bucket, now, 3, 1, "burst 1");
+        ret |= expect_take(&bucket, now + 1000, 3, 1, "burst 1 next interval");
+
+        // 突发为0按1处理
+        token_bucket_init(&bucket, 1000, 0);
+        ret |= expect_take(&bucket, now, 3, 1, "burst 0");
+
+        // 速率为0不限速
+        token_bucket_init(&bucket, 0, 10);
+        ret |= expect_take(&bucket, now, 1000, 1000, "unlimited");
+
+        // 时间比上次取令牌时更早（如调用方各自取的时间）不会多给令牌
+        token_bucket_init(&bucket, 100, 10);
+        ret |= expect_take(&bucket, now, 10, 10, "before going back");
+        ret |= expect_take(&bucket, now - 50000, 5, 0, "time going back");
+
+        if (ret == 0)
+                printf("\e[1;32m====> All token bucket checks passed.\n\e[0m");
+        return ret ? -1 : 0;
+}
@@ -0,0 +1,1025 @@
+#include <stdio.h>
+#include <string.h>
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "udp.h"
+#include "udplite.h"
+
+net_if_t *netif = &net_if_table[0];
+static uint8_t peer_a[NET_IP_LEN] = {192, 168, 163, 10};
+static uint8_t peer_b[NET_IP_LEN] = {192, 168, 163, 11};
+static uint8_t peer_mac[NET_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x10};
+
+/**
+ * 测试用的网卡驱动：不读写pcap文件，发出的帧按顺序记下，由各项检查直接核对
+ */
+#define FRAME_MAX 128
+static uint8_t frames[FRAME_MAX][DRIVER_TX_FRAME_MAX];
+static size_t frame_lens[FRAME_MAX];
+static int frame_num;
+
+int driver_open(net_if_t *netif)
+{
+        return 0;
+}
+
+int driver_recv(buf_t *buf, net_if_t *netif)
+{
+        return 0;
+}
+
+int driver_send(buf_t *buf, net_if_t *netif)
+{
+        if (frame_num == FRAME_MAX || buf->len > DRIVER_TX_FRAME_MAX)
+                return -1;
+        memcpy(frames[frame_num], buf->data, buf->len);
+        frame_lens[frame_num++] = buf->len;
+        return 0;
+}
+
+void driver_tx_begin()
+{
+}
+
+int driver_tx_flush()
+{
+        return 0;
+}
+
+void driver_close(net_if_t *netif)
+{
+}
+
+/**
+ * 与协议栈无关的参考实现：伪首部与l4报文前cover字节按大端16位字累加并折叠，校验和正确时为0xFFFF
+ */
+static uint16_t l4_sum(const uint8_t *ip, const uint8_t *l4, size_t l4_len, size_t cover)
+{
+        uint32_t sum = ip[9] + l4_len;
+        for (int i = 12; i < 20; i += 2)
+                sum += ip[i] << 8 | ip[i + 1];
+        for (size_t i = 0; i < cover; i++)
+                sum += i & 1 ? l4[i] : l4[i] << 8;
+        while (sum >> 16)
+                sum = (sum & 0xffff) + (sum >> 16);
+        return sum;
+}
+
+/**
+ * 从对端向本机注入一个ip包，ip首部按参考实现计算校验和
+ */
+static void inject_ip(const uint8_t *src_ip, uint8_t protocol, const uint8_t *l4, size_t len)
+{
+        static buf_t buf;
+        buf_init(&buf, sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + len);
+        ether_hdr_t *eth = (ether_hdr_t *)buf.data;
+        memcpy(eth->dst, netif->mac, NET_MAC_LEN);
+        memcpy(eth->src, peer_mac, NET_MAC_LEN);
+        eth->protocol16 = swap16(NET_PROTOCOL_IP);
+        uint8_t *ip = (uint8_t *)(eth + 1);
+        memset(ip, 0, sizeof(ip_hdr_t));
+        ip[0] = 0x45;
+        ip[2] = (sizeof(ip_hdr_t) + len) >> 8;
+        ip[3] = (sizeof(ip_hdr_t) + len) & 0xff;
+        ip[8] = 64;
+        ip[9] = protocol;
+        memcpy(ip + 12, src_ip, NET_IP_LEN);
+        memcpy(ip + 16, netif->ip[0], NET_IP_LEN);
+        uint32_t sum = 0;
+        for (int i = 0; i < 20; i += 2)
+                sum += ip[i] << 8 | ip[i + 1];
+        while (sum >> 16)
+                sum = (sum & 0xffff) + (sum >> 16);
+        ip[10] = ~sum >> 8;
+        ip[11] = ~sum & 0xff;
+        memcpy(ip + sizeof(ip_hdr_t), l4, len);
+        ethernet_in(&buf, netif);
+}
+
+/**
+ * 从对端注入一个udp数据报，bad非0时校验和故意出错
+ */
+static void inject_udp(const uint8_t *src_ip, uint16_t src_port, uint16_t dst_port, const void *data, size_t len, int bad)
+{
+        uint8_t l4[ETHERNET_MAX_TRANSPORT_UNIT], ip[20] = {[9] = NET_PROTOCOL_UDP};
+        memcpy(ip + 12, src_ip, NET_IP_LEN);
+        memcpy(ip + 16, netif->ip[0], NET_IP_LEN);
+        udp_hdr_t *hdr = (udp_hdr_t *)l4;
+        hdr->src_port16 = swap16(src_port);
+        hdr->dst_port16 = swap16(dst_port);
+        hdr->total_len16 = swap16(sizeof(udp_hdr_t) + len);
+        hdr->checksum16 = 0;
+        memcpy(l4 + sizeof(udp_hdr_t), data, len);
+        uint16_t checksum = ~l4_sum(ip, l4, sizeof(udp_hdr_t) + len, sizeof(udp_hdr_t) + len);
+        checksum = checksum ? checksum : 0xFFFF;
+        hdr->checksum16 = swap16(checksum + (bad ? 1 : 0));
+        inject_ip(src_ip, NET_PROTOCOL_UDP, l4, sizeof(udp_hdr_t) + len);
+}
+
+/**
+ * 从对端注入一个udp-lite数据报，校验和覆盖首部中coverage所示的长度（0为全部），
+ * 计算校验和后再把数据中第corrupt个字节取反，corrupt为负时不修改
+ */
+static void inject_udplite(const uint8_t *src_ip, uint16_t src_port, uint16_t dst_port, const void *data, size_t len,
+                           uint16_t coverage, int corrupt)
+{
+        uint8_t l4[ETHERNET_MAX_TRANSPORT_UNIT], ip[20] = {[9] = NET_PROTOCOL_UDPLITE};
+        size_t l4_len = sizeof(udplite_hdr_t) + len;
+        memcpy(ip + 12, src_ip, NET_IP_LEN);
+        memcpy(ip + 16, netif->ip[0], NET_IP_LEN);
+        udplite_hdr_t *hdr = (udplite_hdr_t *)l4;
+        hdr->src_port16 = swap16(src_port);
+        hdr->dst_port16 = swap16(dst_port);
+        hdr->coverage16 = swap16(coverage);
+        hdr->checksum16 = 0;
+        memcpy(l4 + sizeof(udplite_hdr_t), data, len);
+        size_t cover = coverage == 0 || coverage > l4_len ? l4_len : coverage;
+        uint16_t checksum = ~l4_sum(ip, l4, l4_len, cover);
+        hdr->checksum16 = swap16(checksum ? checksum : 0xFFFF);
+        if (corrupt >= 0)
+                l4[sizeof(udplite_hdr_t) + corrupt] ^= 0xff;
+        inject_ip(src_ip, NET_PROTOCOL_UDPLITE, l4, l4_len);
+}
+
+/**
+ * 注入对端的arp响应，使对端地址已解析
+ */
+static void inject_arp(const uint8_t *ip)
+{
+        static buf_t buf;
+        buf_init(&buf, sizeof(ether_hdr_t) + sizeof(arp_pkt_t));
+        ether_hdr_t *eth = (ether_hdr_t *)buf.data;
+        memcpy(eth->dst, netif->mac, NET_MAC_LEN);
+        memcpy(eth->src, peer_mac, NET_MAC_LEN);
+        eth->protocol16 = swap16(NET_PROTOCOL_ARP);
+        arp_pkt_t *arp = (arp_pkt_t *)(eth + 1);
+        arp->hw_type16 = swap16(ARP_HW_ETHER);
+        arp->pro_type16 = swap16(NET_PROTOCOL_IP);
+        arp->hw_len = NET_MAC_LEN;
+        arp->pro_len = NET_IP_LEN;
+        arp->opcode16 = swap16(ARP_REPLY);
+        memcpy(arp->sender_mac, peer_mac, NET_MAC_LEN);
+        memcpy(arp->sender_ip, ip, NET_IP_LEN);
+        memcpy(arp->target_mac, netif->mac, NET_MAC_LEN);
+        memcpy(arp->target_ip, netif->ip[0], NET_IP_LEN);
+        ethernet_in(&buf, netif);
+}
+
+/**
+ * 按参考实现核对第index个发出的帧：以太网与ip首部、端口、长度、数据与校验和
+ * protocol为udp-lite时按首部中的覆盖长度校验，否则覆盖整个数据报
+ */
+static int check_frame(int index, uint8_t protocol, const uint8_t *dst_ip, uint16_t src_port, uint16_t dst_port,
+                       const uint8_t *data, size_t len, const char *what)
+{
+        if (index >= frame_num) {
+                printf("\e[1;31m%s: frame %d was not sent\n\e[0m", what, index);
+                return -1;
+        }
+        uint8_t *frame = frames[index];
+        uint8_t *ip = frame + sizeof(ether_hdr_t);
+        uint8_t *l4 = ip + sizeof(ip_hdr_t);
+        size_t l4_len = sizeof(udp_hdr_t) + len;
+        uint32_t sum = 0;
+        for (int i = 0; i < 20; i += 2)
+                sum += ip[i] << 8 | ip[i + 1];
+        while (sum >> 16)
+                sum = (sum & 0xffff) + (sum >> 16);
+        const char *err = NULL;
+        if (frame_lens[index] < sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + l4_len ||
+            memcmp(frame, peer_mac, NET_MAC_LEN) || memcmp(frame + NET_MAC_LEN, netif->mac, NET_MAC_LEN) ||
+            frame[12] != 0x08 || frame[13] != 0x00)
+                err = "bad ethernet header or length";
+        else if (ip[0] != 0x45 || sum != 0xFFFF || ip[9] != protocol || (ip[2] << 8 | ip[3]) != sizeof(ip_hdr_t) + l4_len ||
+                 memcmp(ip + 12, netif->ip[0], NET_IP_LEN) || memcmp(ip + 16, dst_ip, NET_IP_LEN))
+                err = "bad ip header";
+        else if ((l4[0] << 8 | l4[1]) != src_port || (l4[2] << 8 | l4[3]) != dst_port)
+                err = "bad ports";
+        else if (memcmp(l4 + sizeof(udp_hdr_t), data, len))
+                err = "bad data";
+        else if (protocol == NET_PROTOCOL_UDP) {
+                if ((l4[4] << 8 | l4[5]) != l4_len)
+                        err = "bad udp length";
+                else if ((l4[6] | l4[7]) == 0 || l4_sum(ip, l4, l4_len, l4_len) != 0xFFFF)
+                        err = "bad udp checksum";
+        } else {
+                size_t cover = l4[4] << 8 | l4[5];
+                if (cover == 0)
+                        cover = l4_len;
+                if (cover < sizeof(udplite_hdr_t) || cover > l4_len)
+                        err = "bad udp-lite coverage";
+                else if ((l4[6] | l4[7]) == 0 || l4_sum(ip, l4, l4_len, cover) != 0xFFFF)
+                        err = "bad udp-lite checksum";
+        }
+        if (err) {
+                printf("\e[1;31m%s: frame %d %s\n\e[0m", what, index, err);
+                return -1;
+        }
+        return 0;
+}
+
+/**
+ * 检查发出的帧数
+ */
+static int expect_frames(int num, const char *what)
+{
+        if (frame_num != num) {
+                printf("\e[1;31m%s: %d frames sent, expect %d\n\e[0m", what, frame_num, num);
+                return -1;
+        }
+        return 0;
+}
+
+static uint8_t pattern[ETHERNET_MAX_TRANSPORT_UNIT * 4];
+
+/**
+ * 接收环：两种溢出策略、对端地址、批量取出，以及校验和错误与未打开端口的处理
+ */
+static int ring_check()
+{
+        int ret = 0;
+        char msg[8], got[16];
+        uint8_t ip[NET_IP_LEN];
+        uint16_t port;
+
+        // 环满时丢弃新到的数据报
+        udp_socket_t *sock = udp_socket(7000, 4, UDP_OVERFLOW_DROP_NEW);
+        for (int i = 0; i < 6; i++) {
+                sprintf(msg, "msg%d", i);
+                inject_udp(peer_a, 9000, 7000, msg, 4, 0);
+        }
+        for (int i = 0; i < 4; i++) {
+                sprintf(msg, "msg%d", i);
+                if (udp_recv(sock, (uint8_t *)got, sizeof(got), ip, &port) != 4 || memcmp(got, msg, 4) ||
+                    memcmp(ip, peer_a, NET_IP_LEN) || port != 9000) {
+                        printf("\e[1;31mDrop new: expect %s from 9000\n\e[0m", msg);
+                        ret = -1;
+                }
+        }
+        if (udp_recv(sock, (uint8_t *)got, sizeof(got), NULL, NULL) != -1 ||
+            sock->stats.rx_packets != 4 || sock->stats.rx_dropped != 2) {
+                printf("\e[1;31mDrop new: ring should hold 4 and drop 2\n\e[0m");
+                ret = -1;
+        }
+        udp_sock_close(sock);
+
+        // 环满时丢弃最旧的数据报
+        sock = udp_socket(7001, 4, UDP_OVERFLOW_DROP_OLDEST);
+        for (int i = 0; i < 6; i++) {
+                sprintf(msg, "msg%d", i);
+                inject_udp(peer_a, 9000, 7001, msg, 4, 0);
+        }
+        for (int i = 2; i < 6; i++) {
+                sprintf(msg, "msg%d", i);
+                if (udp_recv(sock, (uint8_t *)got, sizeof(got), NULL, NULL) != 4 || memcmp(got, msg, 4)) {
+                        printf("\e[1;31mDrop oldest: expect %s\n\e[0m", msg);
+                        ret = -1;
+                }
+        }
+        if (sock->stats.rx_dropped != 2) {
+                printf("\e[1;31mDrop oldest: %llu dropped, expect 2\n\e[0m", (unsigned long long)sock->stats.rx_dropped);
+                ret = -1;
+        }
+
+        // 批量取出，元数据带上对端与本地地址；校验和错误的被丢弃，校验和为0的不校验
+        inject_udp(peer_a, 9001, 7001, "a", 1, 0);
+        inject_udp(peer_b, 9002, 7001, "bb", 2, 1);
+        inject_udp(peer_b, 9003, 7001, "ccc", 3, 0);
+        uint8_t l4[sizeof(udp_hdr_t) + 4] = {0x23, 0x2c, 0x1b, 0x59, 0, sizeof(l4), 0, 0, 'd', 'd', 'd', 'd'};
+        inject_ip(peer_b, NET_PROTOCOL_UDP, l4, sizeof(l4));
+        udp_msg_t msgs[8];
+        uint8_t bufs[8][16];
+        for (int i = 0; i < 8; i++) {
+                msgs[i].data = bufs[i];
+                msgs[i].len = sizeof(bufs[i]);
+        }
+        int n = udp_recv_batch(sock, msgs, 8);
+        if (n != 3 || msgs[0].len != 1 || msgs[0].port != 9001 || memcmp(msgs[0].ip, peer_a, NET_IP_LEN) ||
+            msgs[1].len != 3 || msgs[1].port != 9003 || memcmp(msgs[1].ip, peer_b, NET_IP_LEN) ||
+            msgs[2].len != 4 || msgs[2].port != 9004 || memcmp(msgs[2].data, "dddd", 4) ||
+            msgs[1].meta.dst_port != 7001 || memcmp(msgs[1].meta.dst_ip, netif->ip[0], NET_IP_LEN)) {
+                printf("\e[1;31mBatch receive: got %d datagrams, expect 3 without the bad checksum\n\e[0m", n);
+                ret = -1;
+        }
+        udp_sock_close(sock);
+
+        // 发往未打开端口的数据报回复端口不可达，不进入任何端口
+        frame_num = 0;
+        inject_udp(peer_a, 9000, 7001, "x", 1, 0);
+        uint8_t *icmp = frames[0] + sizeof(ether_hdr_t) + sizeof(ip_hdr_t);
+        if (frame_num != 1 || frames[0][sizeof(ether_hdr_t) + 9] != NET_PROTOCOL_ICMP ||
+            icmp[0] != ICMP_TYPE_UNREACH || icmp[1] != ICMP_CODE_PORT_UNREACH) {
+                printf("\e[1;31mClosed port: expect a port unreachable\n\e[0m");
+                ret = -1;
+        }
+        return ret;
+}
+
+/**
+ * udp_send与udp_send_batch发出的数据报按参考实现校验，奇数长度的数据报末尾补0后计算
+ */
+static int send_check()
+{
+        int ret = 0;
+        frame_num = 0;
+        ret |= udp_send(pattern, 1, 7000, peer_a, 9000);
+        ret |= udp_send(pattern, 101, 7000, peer_a, 9000);
+        ret |= udp_send(pattern, 1472, 7000, peer_a, 9000);
+        if (udp_send(pattern, 1473, 7000, peer_a, 9000) == 0) {
+                printf("\e[1;31mudp_send: datagram over the mtu should fail with DF set\n\e[0m");
+                ret = -1;
+        }
+        ret |= expect_frames(3, "udp_send");
+        ret |= check_frame(0, NET_PROTOCOL_UDP, peer_a, 7000, 9000, pattern, 1, "udp_send");
+        ret |= check_frame(1, NET_PROTOCOL_UDP, peer_a, 7000, 9000, pattern, 101, "udp_send");
+        ret |= check_frame(2, NET_PROTOCOL_UDP, peer_a, 7000, 9000, pattern, 1472, "udp_send");
+
+        frame_num = 0;
+        udp_msg_t msgs[] = {
+                {.data = pattern, .len = 33, .ip = {192, 168, 163, 10}, .port = 9000},
+                {.data = pattern + 1, .len = 600, .ip = {192, 168, 163, 10}, .port = 9000},
+                {.data = pattern + 2, .len = 7, .ip = {192, 168, 163, 11}, .port = 9001},
+        };
+        if (udp_send_batch(msgs, 3, 7000) != 3) {
+                printf("\e[1;31mudp_send_batch: expect 3 sent\n\e[0m");
+                ret = -1;
+        }
+        ret |= expect_frames(3, "udp_send_batch");
+        ret |= check_frame(0, NET_PROTOCOL_UDP, peer_a, 7000, 9000, pattern, 33, "udp_send_batch");
+        ret |= check_frame(1, NET_PROTOCOL_UDP, peer_a, 7000, 9000, pattern + 1, 600, "udp_send_batch");
+        ret |= check_frame(2, NET_PROTOCOL_UDP, peer_b, 7000, 9001, pattern + 2, 7, "udp_send_batch");
+
+        // 下一跳未解析时只有第一个数据报在arp缓存中等待，其余的会被arp_out丢弃，不计入发送数
+        frame_num = 0;
+        udp_msg_t unresolved[] = {
+                {.data = pattern, .len = 20, .ip = {192, 168, 163, 12}, .port = 9000},
+                {.data = pattern + 1, .len = 21, .ip = {192, 168, 163, 12}, .port = 9000},
+                {.data = pattern + 2, .len = 22, .ip = {192, 168, 163, 12}, .port = 9001},
+        };
+        if (udp_send_batch(unresolved, 3, 7000) != 1) {
+                printf("\e[1;31mudp_send_batch: only the datagram waiting for arp should count\n\e[0m");
+                ret = -1;
+        }
+        ret |= expect_frames(1, "udp_send_batch arp request");
+        inject_arp(unresolved[0].ip);
+        ret |= expect_frames(2, "udp_send_batch resolved");
+        ret |= check_frame(1, NET_PROTOCOL_UDP, unresolved[0].ip, 7000, 9000, pattern, 20, "udp_send_batch resolved");
+        return ret;
+}
+
+/**
+ * 已连接端口按首部模板发送，校验和由部分和累加得到，须与udp_send经udp_checksum得到的一致
+ */
+static int template_check()
+{
+        int ret = 0;
+        size_t lens[] = {1, 2, 101, 1000, 1472};
+        udp_socket_t *sock = udp_connect(7010, peer_a, 9010);
+        for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+                frame_num = 0;
+                ret |= udp_send(pattern, lens[i], 7010, peer_a, 9010);
+                ret |= udp_sock_send(sock, pattern, lens[i]);
+                // 零拷贝发送走同一个模板
+                buf_t *buf = udp_alloc_tx(lens[i]);
+                memcpy(buf->data, pattern, lens[i]);
+                ret |= udp_sock_commit_tx(sock, buf);
+                ret |= expect_frames(3, "template");
+                for (int j = 0; j < 3; j++)
+                        ret |= check_frame(j, NET_PROTOCOL_UDP, peer_a, 7010, 9010, pattern, lens[i], "template");
+                uint8_t *sum = frames[0] + sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 6;
+                if (memcmp(sum, frames[1] + sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 6, 2) ||
+                    memcmp(sum, frames[2] + sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 6, 2)) {
+                        printf("\e[1;31mTemplate: checksum of %zu bytes differs from udp_send\n\e[0m", lens[i]);
+                        ret = -1;
+                }
+        }
+        // 超过mtu的数据报在DF置位时发送失败
+        if (udp_sock_send(sock, pattern, 1473) == 0) {
+                printf("\e[1;31mTemplate: datagram over the mtu should fail\n\e[0m");
+                ret = -1;
+        }
+        udp_sock_close(sock);
+        return ret;
+}
+
+/**
+ * 取出端口接收环中的全部数据报，返回个数，ports依次记下对端端口
+ */
+static int drain(udp_socket_t *sock, uint16_t *ports, int max)
+{
+        uint8_t data[16];
+        uint16_t port;
+        int n = 0;
+        while (udp_recv(sock, data, sizeof(data), NULL, &port) >= 0)
+                if (n < max)
+                        ports[n++] = port;
+        return n;
+}
+
+static uint16_t handler_src_port;
+static uint8_t handler_src_ip[NET_IP_LEN];
+
+static void addr_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+        memcpy(handler_src_ip, src_ip, NET_IP_LEN);
+        handler_src_port = src_port;
+}
+
+/**
+ * 按四元组分发：已连接端口优先于监听端口，与打开顺序无关，关闭后回落到监听端口；
+ * 处理程序收到的是对端的地址与端口
+ */
+static int demux_check()
+{
+        int ret = 0;
+        uint16_t ports[8];
+        udp_socket_t *listener = udp_socket(7020, 0, UDP_OVERFLOW_DROP_NEW);
+        udp_socket_t *conn = udp_connect(7020, peer_a, 9020);
+        if (udp_connect(7020, peer_a, 9020) != conn) {
+                printf("\e[1;31mDemux: connecting the same 4-tuple should return the same socket\n\e[0m");
+                ret = -1;
+        }
+        inject_udp(peer_a, 9020, 7020, "a", 1, 0);
+        inject_udp(peer_a, 9021, 7020, "b", 1, 0);
+        inject_udp(peer_b, 9020, 7020, "c", 1, 0);
+        if (drain(conn, ports, 8) != 1 || ports[0] != 9020 ||
+            drain(listener, ports, 8) != 2 || ports[0] != 9021 || ports[1] != 9020) {
+                printf("\e[1;31mDemux: the connected peer should reach only the connected socket\n\e[0m");
+                ret = -1;
+        }
+        udp_sock_close(conn);
+        inject_udp(peer_a, 9020, 7020, "d", 1, 0);
+        if (drain(listener, ports, 8) != 1) {
+                printf("\e[1;31mDemux: after closing the connected socket its peer should reach the listener\n\e[0m");
+                ret = -1;
+        }
+        udp_sock_close(listener);
+
+        // 已连接端口先打开、监听端口后打开
+        conn = udp_connect(7021, peer_a, 9020);
+        listener = udp_socket(7021, 0, UDP_OVERFLOW_DROP_NEW);
+        inject_udp(peer_a, 9020, 7021, "e", 1, 0);
+        inject_udp(peer_a, 9022, 7021, "f", 1, 0);
+        if (drain(conn, ports, 8) != 1 || ports[0] != 9020 || drain(listener, ports, 8) != 1 || ports[0] != 9022) {
+                printf("\e[1;31mDemux: the connected socket should win regardless of open order\n\e[0m");
+                ret = -1;
+        }
+        udp_sock_close(conn);
+        udp_sock_close(listener);
+
+        udp_open(7022, addr_handler);
+        inject_udp(peer_b, 9023, 7022, "g", 1, 0);
+        if (handler_src_port != 9023 || memcmp(handler_src_ip, peer_b, NET_IP_LEN)) {
+                printf("\e[1;31mDemux: the handler should get the source address and port\n\e[0m");
+                ret = -1;
+        }
+        udp_close(7022);
+        return ret;
+}
+
+/**
+ * reuseport组按流哈希分担：每个流的数据报都进入同一端口，各端口都分到流
+ */
+#define REUSEPORT_NUM 4
+#define REUSEPORT_FLOWS 64
+static int reuseport_check()
+{
+        int ret = 0;
+        udp_socket_t *socks[REUSEPORT_NUM];
+        uint16_t ports[2 * REUSEPORT_FLOWS];
+        int owner[REUSEPORT_FLOWS], count[REUSEPORT_FLOWS] = {0};
+        for (int i = 0; i < REUSEPORT_NUM; i++)
+                socks[i] = udp_socket_reuseport(7030, 0, UDP_OVERFLOW_DROP_NEW);
+        if (udp_socket(7030, 0, UDP_OVERFLOW_DROP_NEW) != NULL) {
+                printf("\e[1;31mReuseport: a plain socket should not join the group\n\e[0m");
+                ret = -1;
+        }
+        for (int round = 0; round < 2; round++)
+                for (int i = 0; i < REUSEPORT_FLOWS; i++)
+                        inject_udp(peer_a, 10000 + i, 7030, "r", 1, 0);
+        for (int i = 0; i < REUSEPORT_NUM; i++) {
+                int n = drain(socks[i], ports, 2 * REUSEPORT_FLOWS);
+                if (n == 0) {
+                        printf("\e[1;31mReuseport: socket %d got no flow\n\e[0m", i);
+                        ret = -1;
+                }
+                for (int j = 0; j < n; j++) {
+                        int flow = ports[j] - 10000;
+                        if (count[flow]++ && owner[flow] != i) {
+                                printf("\e[1;31mReuseport: flow %d split across sockets\n\e[0m", flow);
+                                ret = -1;
+                        }
+                        owner[flow] = i;
+                }
+        }
+        for (int i = 0; i < REUSEPORT_FLOWS; i++)
+                if (count[i] != 2) {
+                        printf("\e[1;31mReuseport: flow %d delivered %d times, expect 2\n\e[0m", i, count[i]);
+                        ret = -1;
+                }
+
+        // 已连接端口优先于reuseport组
+        udp_socket_t *conn = udp_connect(7030, peer_a, 10000);
+        inject_udp(peer_a, 10000, 7030, "s", 1, 0);
+        if (drain(conn, ports, 8) != 1) {
+                printf("\e[1;31mReuseport: the connected socket should take its flow from the group\n\e[0m");
+                ret = -1;
+        }
+        udp_sock_close(conn);
+        udp_close(7030);
+        return ret;
+}
+
+/**
+ * 临时端口：从随机位置开始分配并绕回，显式打开的端口不会再分出，耗尽后失败，关闭后可再分出
+ */
+#define EPHEMERAL_NUM (UDP_EPHEMERAL_MAX - UDP_EPHEMERAL_MIN + 1)
+static int ephemeral_check()
+{
+        int ret = 0;
+        udp_socket_t *socks[EPHEMERAL_NUM];
+        uint8_t used[EPHEMERAL_NUM] = {0};
+        socks[0] = udp_socket(UDP_EPHEMERAL_MIN + 4, 0, UDP_OVERFLOW_DROP_NEW);
+        used[4] = 1;
+        for (int i = 1; i < EPHEMERAL_NUM; i++) {
+                socks[i] = udp_socket(0, 0, UDP_OVERFLOW_DROP_NEW);
+                if (socks[i] == NULL || socks[i]->port < UDP_EPHEMERAL_MIN || socks[i]->port > UDP_EPHEMERAL_MAX ||
+                    used[socks[i]->port - UDP_EPHEMERAL_MIN]++) {
+                        printf("\e[1;31mEphemeral: allocation %d is missing, out of range or in use\n\e[0m", i);
+                        return -1;
+                }
+        }
+        if (udp_socket(0, 0, UDP_OVERFLOW_DROP_NEW) != NULL || udp_connect(0, peer_a, 9040) != NULL) {
+                printf("\e[1;31mEphemeral: allocation should fail when the range is exhausted\n\e[0m");
+                ret = -1;
+        }
+        // 释放的端口可以再次分出
+        uint16_t port = socks[EPHEMERAL_NUM / 2]->port;
+        udp_sock_close(socks[EPHEMERAL_NUM / 2]);
+        socks[EPHEMERAL_NUM / 2] = udp_socket(0, 0, UDP_OVERFLOW_DROP_NEW);
+        if (socks[EPHEMERAL_NUM / 2] == NULL || socks[EPHEMERAL_NUM / 2]->port != port) {
+                printf("\e[1;31mEphemeral: the released port %u should be allocated again\n\e[0m", port);
+                ret = -1;
+        }
+        for (int i = 0; i < EPHEMERAL_NUM; i++)
+                if (socks[i])
+                        udp_sock_close(socks[i]);
+        // 全部关闭后重新分配不应失败
+        udp_socket_t *sock = udp_socket(0, 0, UDP_OVERFLOW_DROP_NEW);
+        if (sock == NULL) {
+                printf("\e[1;31mEphemeral: allocation should succeed after all ports are closed\n\e[0m");
+                return -1;
+        }
+        udp_sock_close(sock);
+        return ret;
+}
+
+/**
+ * 塞住的端口：合并到恰好路径mtu时立即发出，追加后超过mtu时先发出已合并的部分，
+ * 其余在udp_flush_corked、打开端口或关闭端口时发出
+ */
+static int cork_check()
+{
+        int ret = 0;
+        size_t mtu = udp_mtu(peer_a), off = 0;
+        udp_socket_t *sock = udp_connect(7050, peer_a, 9050);
+        frame_num = 0;
+        udp_sock_cork(sock, 1);
+        for (int i = 0; i < 3; i++, off += 490)
+                ret |= udp_sock_send(sock, pattern + off, 490);
+        ret |= expect_frames(0, "cork below mtu");
+        ret |= udp_sock_send(sock, pattern + off, mtu - off);
+        ret |= expect_frames(1, "cork at mtu");
+        ret |= check_frame(0, NET_PROTOCOL_UDP, peer_a, 7050, 9050, pattern, mtu, "cork at mtu");
+
+        off = 0;
+        for (int i = 0; i < 2; i++, off += 500)
+                ret |= udp_sock_send(sock, pattern + off, 500);
+        ret |= udp_sock_send(sock, pattern + off, 500);
+        ret |= expect_frames(2, "cork over mtu");
+        ret |= check_frame(1, NET_PROTOCOL_UDP, peer_a, 7050, 9050, pattern, 1000, "cork over mtu");
+        udp_flush_corked();
+        ret |= expect_frames(3, "udp_flush_corked");
+        ret |= check_frame(2, NET_PROTOCOL_UDP, peer_a, 7050, 9050, pattern + off, 500, "udp_flush_corked");
+        udp_flush_corked();
+        ret |= expect_frames(3, "udp_flush_corked with nothing pending");
+
+        ret |= udp_sock_send(sock, pattern, 100);
+        ret |= udp_sock_cork(sock, 0);
+        ret |= expect_frames(4, "uncork");
+        ret |= check_frame(3, NET_PROTOCOL_UDP, peer_a, 7050, 9050, pattern, 100, "uncork");
+        ret |= udp_sock_send(sock, pattern, 10);
+        ret |= expect_frames(5, "uncorked send");
+
+        udp_sock_cork(sock, 1);
+        ret |= udp_sock_send(sock, pattern, 20);
+        udp_sock_close(sock);
+        ret |= expect_frames(6, "close while corked");
+        ret |= check_frame(5, NET_PROTOCOL_UDP, peer_a, 7050, 9050, pattern, 20, "close while corked");
+        return ret;
+}
+
+static int udplite_delivered;
+static void udplite_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+        udplite_delivered++;
+}
+
+/**
+ * 注入一个udp-lite数据报，检查是否递交给端口
+ */
+static int expect_udplite(uint16_t coverage, int corrupt, int delivered, const char *what)
+{
+        udplite_delivered = 0;
+        inject_udplite(peer_a, 9060, 7060, pattern, 40, coverage, corrupt);
+        if (udplite_delivered != delivered) {
+                printf("\e[1;31mUDP-Lite: %s should be %s\n\e[0m", what, delivered ? "delivered" : "dropped");
+                return -1;
+        }
+        return 0;
+}
+
+/**
+ * udp-lite覆盖长度：接收时校验覆盖范围与端口要求的最小覆盖长度，覆盖范围外的损坏不影响递交；
+ * 发送时首部带上端口设置的覆盖长度，校验和只覆盖这部分
+ */
+static int udplite_check()
+{
+        int ret = 0;
+        udplite_open(7060, udplite_handler);
+        if (udplite_set_coverage(7060, 4, 0) == 0 || udplite_set_coverage(7061, 16, 16) == 0) {
+                printf("\e[1;31mUDP-Lite: coverage shorter than the header or on a closed port should be refused\n\e[0m");
+                ret = -1;
+        }
+        // 要求至少覆盖首部与12字节数据
+        udplite_set_coverage(7060, 0, 20);
+        ret |= expect_udplite(0, -1, 1, "full coverage");
+        ret |= expect_udplite(20, -1, 1, "coverage at the minimum");
+        ret |= expect_udplite(28, 30, 1, "corruption outside the coverage");
+        ret |= expect_udplite(20, 5, 0, "corruption inside the coverage");
+        ret |= expect_udplite(12, -1, 0, "coverage below the minimum");
+        ret |= expect_udplite(4, -1, 0, "coverage shorter than the header");
+        ret |= expect_udplite(60, -1, 0, "coverage beyond the datagram");
+        // 要求覆盖全部
+        udplite_set_coverage(7060, 0, 0);
+        ret |= expect_udplite(20, -1, 0, "partial coverage on a full-coverage port");
+        ret |= expect_udplite(48, -1, 1, "coverage equal to the datagram");
+
+        // 发送时的覆盖长度
+        frame_num = 0;
+        udplite_set_coverage(7060, 16, 0);
+        ret |= udplite_send(pattern, 40, 7060, peer_a, 9060);
+        udplite_set_coverage(7060, 100, 0);
+        ret |= udplite_send(pattern, 40, 7060, peer_a, 9060);
+        udplite_set_coverage(7060, 0, 0);
+        ret |= udplite_send(pattern, 41, 7060, peer_a, 9060);
+        ret |= expect_frames(3, "udplite_send");
+        uint16_t expect[] = {16, 0, 0};
+        for (int i = 0; i < 3; i++) {
+                uint8_t *l4 = frames[i] + sizeof(ether_hdr_t) + sizeof(ip_hdr_t);
+                ret |= check_frame(i, NET_PROTOCOL_UDPLITE, peer_a, 7060, 9060, pattern, i < 2 ? 40 : 41, "udplite_send");
+                if ((l4[4] << 8 | l4[5]) != expect[i]) {
+                        printf("\e[1;31mUDP-Lite: frame %d coverage %u, expect %u\n\e[0m", i, l4[4] << 8 | l4[5], expect[i]);
+                        ret = -1;
+                }
+        }
+        udplite_close(7060);
+        return ret;
+}
+
+/**
+ * 检查第a、b个帧的udp校验和字段相同
+ */
+static int same_checksum(int a, int b, const char *what)
+{
+        size_t off = sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 6;
+        if (a >= frame_num || b >= frame_num || memcmp(frames[a] + off, frames[b] + off, 2)) {
+                printf("\e[1;31m%s: checksum of frame %d differs from frame %d\n\e[0m", what, b, a);
+                return -1;
+        }
+        return 0;
+}
+
+/**
+ * udp_sendv复制各段时累加校验和，奇数长度的段使后续段从奇数偏移开始，结果须与udp_send一致
+ */
+static int sendv_check()
+{
+        int ret = 0;
+        size_t lens[] = {3, 5, 0, 1, 200, 77, 2};
+        struct iovec iov[sizeof(lens) / sizeof(lens[0])];
+        size_t off = 0;
+        for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+                iov[i].iov_base = pattern + off;
+                iov[i].iov_len = lens[i];
+                off += lens[i];
+        }
+        frame_num = 0;
+        ret |= udp_send(pattern, off, 7070, peer_a, 9070);
+        ret |= udp_sendv(iov, sizeof(lens) / sizeof(lens[0]), 7070, peer_a, 9070);
+        ret |= udp_sendv(iov, 0, 7070, peer_a, 9070);
+        ret |= expect_frames(3, "udp_sendv");
+        ret |= check_frame(1, NET_PROTOCOL_UDP, peer_a, 7070, 9070, pattern, off, "udp_sendv");
+        ret |= same_checksum(0, 1, "udp_sendv");
+        ret |= check_frame(2, NET_PROTOCOL_UDP, peer_a, 7070, 9070, pattern, 0, "udp_sendv empty");
+
+        // 超过mtu的数据报在DF置位时发送失败
+        struct iovec big[] = {{pattern, 1000}, {pattern + 1000, 473}};
+        if (udp_sendv(big, 2, 7070, peer_a, 9070) == 0) {
+                printf("\e[1;31mudp_sendv: datagram over the mtu should fail\n\e[0m");
+                ret = -1;
+        }
+        return ret;
+}
+
+/**
+ * udp_send_gso切分出的每个数据报按参考实现校验，校验和须与udp_send单独发送该段时一致
+ */
+static int gso_case(size_t len, uint16_t segment_size, int segs)
+{
+        int ret = 0;
+        char what[32];
+        size_t seg = segment_size ? segment_size : udp_mtu(peer_a);
+        sprintf(what, "gso %zu/%u", len, segment_size);
+        frame_num = 0;
+        if (udp_send_gso(pattern + 1, len, segment_size, 7080, peer_a, 9080) != segs) {
+                printf("\e[1;31m%s: expect %d segments\n\e[0m", what, segs);
+                return -1;
+        }
+        for (int i = 0; i < segs; i++) {
+                size_t seg_len = len - i * seg < seg ? len - i * seg : seg;
+                ret |= udp_send(pattern + 1 + i * seg, seg_len, 7080, peer_a, 9080);
+                ret |= check_frame(i, NET_PROTOCOL_UDP, peer_a, 7080, 9080, pattern + 1 + i * seg, seg_len, what);
+                ret |= same_checksum(segs + i, i, what);
+        }
+        ret |= expect_frames(2 * segs, what);
+        return ret;
+}
+
+static int gso_check()
+{
+        int ret = 0;
+        ret |= gso_case(2500, 1000, 3);
+        ret |= gso_case(2500, 777, 4);
+        ret |= gso_case(2000, 500, 4);
+        ret |= gso_case(3000, 0, 3);
+        ret |= gso_case(1, 1000, 1);
+        // 分段超过路径mtu或段数超过上限时失败
+        if (udp_send_gso(pattern, 2000, 1473, 7080, peer_a, 9080) != -1 ||
+            udp_send_gso(pattern, (UDP_GSO_MAX_SEGS + 1) * 10, 10, 7080, peer_a, 9080) != -1) {
+                printf("\e[1;31mgso: oversize segments or too many segments should fail\n\e[0m");
+                ret = -1;
+        }
+        // 下一跳未解析时只有第一段在arp缓存中等待，再发送时一段也不能等待
+        uint8_t unresolved[NET_IP_LEN] = {192, 168, 163, 13};
+        frame_num = 0;
+        if (udp_send_gso(pattern, 2500, 1000, 7080, unresolved, 9080) != 1 ||
+            udp_send_gso(pattern, 2500, 1000, 7080, unresolved, 9080) != 0) {
+                printf("\e[1;31mgso: only the first segment can wait for arp\n\e[0m");
+                ret = -1;
+        }
+        ret |= expect_frames(1, "gso arp request");
+        inject_arp(unresolved);
+        ret |= expect_frames(2, "gso resolved");
+        ret |= check_frame(1, NET_PROTOCOL_UDP, unresolved, 7080, 9080, pattern, 1000, "gso resolved");
+        return ret;
+}
+
+/**
+ * 合并递交的处理程序记下每次调用的端口、对端与数据报的首字节
+ */
+#define GRO_CALL_MAX 8
+static struct {
+        udp_socket_t *sock;
+        uint8_t ip[NET_IP_LEN];
+        uint16_t port;
+        int n;
+        char data[UDP_GRO_MAX + 1];
+} gro_calls[GRO_CALL_MAX];
+static int gro_call_num;
+static udp_socket_t *gro_close_sock;
+
+static void gro_handler(udp_socket_t *sock, udp_msg_t *msgs, int n)
+{
+        if (gro_call_num == GRO_CALL_MAX)
+                return;
+        gro_calls[gro_call_num].sock = sock;
+        memcpy(gro_calls[gro_call_num].ip, msgs[0].ip, NET_IP_LEN);
+        gro_calls[gro_call_num].port = msgs[0].port;
+        gro_calls[gro_call_num].n = n;
+        for (int i = 0; i < n && i < UDP_GRO_MAX; i++) {
+                if (msgs[i].port != msgs[0].port || memcmp(msgs[i].ip, msgs[0].ip, NET_IP_LEN))
+                        gro_calls[gro_call_num].n = -1;
+                gro_calls[gro_call_num].data[i] = msgs[i].data[0];
+        }
+        gro_calls[gro_call_num++].data[n < UDP_GRO_MAX ? n : UDP_GRO_MAX] = 0;
+        if (gro_close_sock) {
+                udp_sock_close(gro_close_sock);
+                gro_close_sock = NULL;
+        }
+}
+
+/**
+ * 检查第index次合并递交的端口、对端与按到达顺序排列的数据
+ */
+static int expect_gro_call(int index, udp_socket_t *sock, const uint8_t *ip, uint16_t port, const char *data, const char *what)
+{
+        if (index >= gro_call_num || gro_calls[index].sock != sock || gro_calls[index].port != port ||
+            memcmp(gro_calls[index].ip, ip, NET_IP_LEN) || gro_calls[index].n != (int)strlen(data) ||
+            strcmp(gro_calls[index].data, data)) {
+                printf("\e[1;31m%s: delivery %d should be %s from port %u\n\e[0m", what, index, data, port);
+                return -1;
+        }
+        return 0;
+}
+
+/**
+ * 合并递交：同一端口同一对端的数据报按到达顺序合并，各流按首个数据报的到达顺序递交，
+ * 暂存区满时提前递交，处理程序中关闭的端口不再递交
+ */
+static int gro_check()
+{
+        int ret = 0;
+        udp_socket_t *sock = udp_socket(7100, 0, UDP_OVERFLOW_DROP_NEW);
+        udp_socket_t *other = udp_socket(7101, 0, UDP_OVERFLOW_DROP_NEW);
+        udp_set_batch_handler(sock, gro_handler);
+        udp_set_batch_handler(other, gro_handler);
+
+        gro_call_num = 0;
+        inject_udp(peer_a, 9100, 7100, "a", 1, 0);
+        inject_udp(peer_b, 9100, 7100, "b", 1, 0);
+        inject_udp(peer_a, 9101, 7100, "c", 1, 0);
+        inject_udp(peer_a, 9100, 7101, "d", 1, 0);
+        inject_udp(peer_a, 9100, 7100, "e", 1, 0);
+        inject_udp(peer_b, 9100, 7100, "f", 1, 0);
+        if (gro_call_num != 0) {
+                printf("\e[1;31mGRO: datagrams should wait for the flush\n\e[0m");
+                ret = -1;
+        }
+        udp_gro_flush();
+        if (gro_call_num != 4) {
+                printf("\e[1;31mGRO: %d deliveries, expect one per flow\n\e[0m", gro_call_num);
+                ret = -1;
+        }
+        ret |= expect_gro_call(0, sock, peer_a, 9100, "ae", "GRO");
+        ret |= expect_gro_call(1, sock, peer_b, 9100, "bf", "GRO");
+        ret |= expect_gro_call(2, sock, peer_a, 9101, "c", "GRO");
+        ret |= expect_gro_call(3, other, peer_a, 9100, "d", "GRO");
+
+        // 暂存区满时先递交已暂存的，再暂存新到的数据报
+        char full[UDP_GRO_MAX + 1];
+        gro_call_num = 0;
+        for (int i = 0; i <= UDP_GRO_MAX; i++) {
+                full[i] = 'A' + i % 26;
+                inject_udp(peer_a, 9100, 7100, &full[i], 1, 0);
+        }
+        full[UDP_GRO_MAX] = 0;
+        if (gro_call_num != 1) {
+                printf("\e[1;31mGRO: a full staging area should flush early\n\e[0m");
+                ret = -1;
+        }
+        ret |= expect_gro_call(0, sock, peer_a, 9100, full, "GRO full");
+        udp_gro_flush();
+        full[0] = 'A' + UDP_GRO_MAX % 26;
+        full[1] = 0;
+        ret |= expect_gro_call(1, sock, peer_a, 9100, full, "GRO full");
+
+        // 先递交的处理程序关闭了后一个端口
+        gro_call_num = 0;
+        inject_udp(peer_a, 9100, 7100, "g", 1, 0);
+        inject_udp(peer_a, 9100, 7101, "h", 1, 0);
+        gro_close_sock = other;
+        udp_gro_flush();
+        udp_gro_flush();
+        if (gro_call_num != 1) {
+                printf("\e[1;31mGRO: a socket closed during the flush should get nothing\n\e[0m");
+                ret = -1;
+        }
+        ret |= expect_gro_call(0, sock, peer_a, 9100, "g", "GRO close");
+        udp_sock_close(sock);
+        return ret;
+}
+
+static struct {
+        int num;
+        uint16_t port, dst_port;
+        uint8_t dst_ip[NET_IP_LEN];
+        uint8_t code;
+} err_got;
+static int listener_err_num;
+
+static void err_handler(uint16_t port, uint8_t *dst_ip, uint16_t dst_port, uint8_t code)
+{
+        err_got.num++;
+        err_got.port = port;
+        memcpy(err_got.dst_ip, dst_ip, NET_IP_LEN);
+        err_got.dst_port = dst_port;
+        err_got.code = code;
+}
+
+static void err_handler_listener(uint16_t port, uint8_t *dst_ip, uint16_t dst_port, uint8_t code)
+{
+        listener_err_num++;
+}
+
+/**
+ * 对端回复目的不可达，引用本机发出的第index个帧的ip首部与udp首部
+ */
+static void inject_unreach(int index, uint8_t code)
+{
+        uint8_t icmp[sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + sizeof(udp_hdr_t)] = {ICMP_TYPE_UNREACH, code};
+        memcpy(icmp + sizeof(icmp_hdr_t), frames[index] + sizeof(ether_hdr_t), sizeof(ip_hdr_t) + sizeof(udp_hdr_t));
+        uint32_t sum = 0;
+        for (size_t i = 0; i < sizeof(icmp); i += 2)
+                sum += icmp[i] << 8 | icmp[i + 1];
+        while (sum >> 16)
+                sum = (sum & 0xffff) + (sum >> 16);
+        icmp[2] = ~sum >> 8;
+        icmp[3] = ~sum & 0xff;
+        inject_ip(peer_a, NET_PROTOCOL_ICMP, icmp, sizeof(icmp));
+}
+
+/**
+ * 对端回复的icmp目的不可达递交给发出原数据报的端口：带上本地端口、对端地址与代码，
+ * 已连接端口优先于监听端口，没有端口或不是本机发出的数据报时不递交
+ */
+static int err_check()
+{
+        int ret = 0;
+        udp_socket_t *listener = udp_socket(7090, 0, UDP_OVERFLOW_DROP_NEW);
+        udp_socket_t *conn = udp_connect(7090, peer_a, 9091);
+        if (udp_set_err_handler(7090, err_handler) < 0 || udp_set_err_handler(7099, err_handler) == 0) {
+                printf("\e[1;31mError handler: should be set only on open ports\n\e[0m");
+                ret = -1;
+        }
+        listener->err_handler = err_handler_listener;
+
+        frame_num = 0;
+        udp_send(pattern, 10, 7090, peer_a, 9090);
+        udp_sock_send(conn, pattern, 10);
+        udp_send(pattern, 10, 7098, peer_a, 9090);
+
+        // 端口不可达递交给监听端口
+        memset(&err_got, 0, sizeof(err_got));
+        listener_err_num = 0;
+        inject_unreach(0, ICMP_CODE_PORT_UNREACH);
+        if (listener_err_num != 1 || err_got.num != 0) {
+                printf("\e[1;31mError: port unreachable for the listener's datagram should reach only the listener\n\e[0m");
+                ret = -1;
+        }
+        // 已连接端口的对端发来的差错递交给已连接端口，带上原数据报的地址与代码
+        memset(&err_got, 0, sizeof(err_got));
+        listener_err_num = 0;
+        inject_unreach(1, ICMP_CODE_PORT_UNREACH);
+        inject_unreach(1, 1);
+        if (err_got.num != 2 || listener_err_num != 0 || err_got.port != 7090 ||
+            memcmp(err_got.dst_ip, peer_a, NET_IP_LEN) || err_got.dst_port != 9091 || err_got.code != 1) {
+                printf("\e[1;31mError: unreachable for the connected peer should reach the connected socket with its code\n\e[0m");
+                ret = -1;
+        }
+        // 没有打开的端口
+        memset(&err_got, 0, sizeof(err_got));
+        listener_err_num = 0;
+        inject_unreach(2, ICMP_CODE_PORT_UNREACH);
+        // 不是本机发出的数据报
+        memcpy(frames[0] + sizeof(ether_hdr_t) + 12, peer_b, NET_IP_LEN);
+        inject_unreach(0, ICMP_CODE_PORT_UNREACH);
+        if (err_got.num || listener_err_num) {
+                printf("\e[1;31mError: errors for closed ports or other hosts' datagrams should be ignored\n\e[0m");
+                ret = -1;
+        }
+        udp_close(7090);
+        return ret;
+}
+
+int main(int argc, char* argv[])
+{
+        int ret = 0;
+        printf("\e[0;34mUDP test.\n\e[0m");
+        for (size_t i = 0; i < sizeof(pattern); i++)
+                pattern[i] = i * 7 + (i >> 8);
+
+        net_init();
+        inject_arp(peer_a);
+        inject_arp(peer_b);
+
+        ret |= ring_check();
+        ret |= send_check();
+        ret |= template_check();
+        ret |= demux_check();
+        ret |= reuseport_check();
+        ret |= ephemeral_check();
+        ret |= cork_check();
+        ret |= udplite_check();
+        ret |= sendv_check();
+        ret |= gso_check();
+        ret |= gro_check();
+        ret |= err_check();
+
+        if (ret == 0)
+                printf("\e[1;32m====> All udp checks passed.\n\e[0m");
+        return ret ? -1 : 0;
+}